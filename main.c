@@ -1,15 +1,34 @@
 // clang-format off
 // # vim: tabstop=2 shiftwidth=2 expandtab
 // Build this with:
-// $ gcc -g -o demo main.c xdg-shell-protocol.c -lwayland-client -lpthread -lvulkan -lm
+// $ gcc -g -o demo main.c xdg-shell-protocol.c presentation-time-protocol.c tearing-control-v1-protocol.c fifo-v1-protocol.c commit-timing-v1-protocol.c viewporter-protocol.c fractional-scale-v1-protocol.c single-pixel-buffer-v1-protocol.c linux-dmabuf-v1-protocol.c -lwayland-client -lpthread -lvulkan -lm
+// Add -DTRACE to record a Chrome/Perfetto trace of every frame, see Tracing.
 // Generate the xdg-shell files from protocols with
 // $ wayland-scanner private-code < /usr/share/wayland-protocols/stable/xdg-shell/xdg-shell.xml > xdg-shell-protocol.c
 // $ wayland-scanner client-header < /usr/share/wayland-protocols/stable/xdg-shell/xdg-shell.xml > xdg-shell-client-protocol.h
+// $ wayland-scanner private-code < /usr/share/wayland-protocols/stable/presentation-time/presentation-time.xml > presentation-time-protocol.c
+// $ wayland-scanner client-header < /usr/share/wayland-protocols/stable/presentation-time/presentation-time.xml > presentation-time-client-protocol.h
+// $ wayland-scanner private-code < /usr/share/wayland-protocols/staging/tearing-control/tearing-control-v1.xml > tearing-control-v1-protocol.c
+// $ wayland-scanner client-header < /usr/share/wayland-protocols/staging/tearing-control/tearing-control-v1.xml > tearing-control-v1-client-protocol.h
+// $ wayland-scanner private-code < /usr/share/wayland-protocols/staging/fifo/fifo-v1.xml > fifo-v1-protocol.c
+// $ wayland-scanner client-header < /usr/share/wayland-protocols/staging/fifo/fifo-v1.xml > fifo-v1-client-protocol.h
+// $ wayland-scanner private-code < /usr/share/wayland-protocols/staging/commit-timing/commit-timing-v1.xml > commit-timing-v1-protocol.c
+// $ wayland-scanner client-header < /usr/share/wayland-protocols/staging/commit-timing/commit-timing-v1.xml > commit-timing-v1-client-protocol.h
+// $ wayland-scanner private-code < /usr/share/wayland-protocols/stable/viewporter/viewporter.xml > viewporter-protocol.c
+// $ wayland-scanner client-header < /usr/share/wayland-protocols/stable/viewporter/viewporter.xml > viewporter-client-protocol.h
+// $ wayland-scanner private-code < /usr/share/wayland-protocols/staging/fractional-scale/fractional-scale-v1.xml > fractional-scale-v1-protocol.c
+// $ wayland-scanner client-header < /usr/share/wayland-protocols/staging/fractional-scale/fractional-scale-v1.xml > fractional-scale-v1-client-protocol.h
+// $ wayland-scanner private-code < /usr/share/wayland-protocols/staging/single-pixel-buffer/single-pixel-buffer-v1.xml > single-pixel-buffer-v1-protocol.c
+// $ wayland-scanner client-header < /usr/share/wayland-protocols/staging/single-pixel-buffer/single-pixel-buffer-v1.xml > single-pixel-buffer-v1-client-protocol.h
+// $ wayland-scanner private-code < /usr/share/wayland-protocols/stable/linux-dmabuf/linux-dmabuf-v1.xml > linux-dmabuf-v1-protocol.c
+// $ wayland-scanner client-header < /usr/share/wayland-protocols/stable/linux-dmabuf/linux-dmabuf-v1.xml > linux-dmabuf-v1-client-protocol.h
 // Generate the shader binaries with
 // $ glslc -o - shader.frag | xxd -i -n frag_spv > shaders.h
 // $ glslc -o - shader.vert | xxd -i -n vert_spv >> shaders.h
 // clang-format on
 
+#define _GNU_SOURCE // memfd_create
+
 #include <vulkan/vulkan.h>
 #include <vulkan/vulkan_wayland.h>
 #include <wayland-client.h>
@@ -17,21 +36,92 @@
 
 #include "shaders.h"                   // Only suffering exists in this world.
 #include "xdg-shell-client-protocol.h" // True suffering is generated code.
+#include "presentation-time-client-protocol.h"
+#include "tearing-control-v1-client-protocol.h"
+#include "fifo-v1-client-protocol.h"
+#include "commit-timing-v1-client-protocol.h"
+#include "viewporter-client-protocol.h"
+#include "fractional-scale-v1-client-protocol.h"
+#include "single-pixel-buffer-v1-client-protocol.h"
+#include "linux-dmabuf-v1-client-protocol.h"
 
 #include <assert.h>
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <linux/dma-buf.h>
 #include <math.h>
 #include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/signalfd.h>
+#include <sys/sysmacros.h>
+#include <sys/timerfd.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <stdio.h>
 #include <stdlib.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #define ARRAY_SIZEOF(A) (sizeof(A) / sizeof(A[0]))
 #define VK_VALIDATION
 #define CLAMP(V, L, H) (V < L ? L : (V > H ? H : V))
+#define MAX(A, B) ((A) > (B) ? (A) : (B))
+#define MIN(A, B) ((A) < (B) ? (A) : (B))
+#define FOURCC(A, B, C, D)                                                     \
+  ((uint32_t)(A) | (uint32_t)(B) << 8 | (uint32_t)(C) << 16 |                 \
+   (uint32_t)(D) << 24)
+
+// Device memory out of vk_memory_alloc, a range of one of its blocks or an
+// allocation of its own.
+struct vk_block;
+struct vk_alloc {
+  VkDeviceMemory mem;
+  VkDeviceSize offset;
+  void *mapped; // At offset, if host visible.
+  struct vk_block *block; // NULL if dedicated.
+  uint32_t order;
+};
+
+// Everything there is one of per swapchain image.
+struct swap_image {
+  VkImage img;
+  struct vk_alloc alloc; // Backing img when headless.
+  VkDeviceMemory mem;    // Backing img with --dmabuf, exported on its own.
+  VkImageView view;
+  VkFramebuffer fb;
+  // Signalled by rendering into the image and waited on by its present, so it
+  // is free to reuse once the image is acquired again. Made with the
+  // swapchain, a present to the old one may still be waiting.
+  VkSemaphore renderFinished;
+  uint64_t presented; // RENDER.presents when it was last presented, or 0.
+  // What our last frame left in the image, if it was drawn at full size: the
+  // clear colour and the box around the triangle.
+  bool drawn;
+  bool pressed;
+  VkRect2D box;
+  // --dmabuf only. The exported memory and its wl_buffer, busy in DMABUF from
+  // its commit until the compositor releases it. Foreign once handed over, it
+  // has to be taken back before it is drawn to again.
+  int fd;
+  struct wl_buffer *buffer;
+  bool foreign;
+};
+
+struct dmabuf_formats;
 
 // Window system information
 struct wsi {
@@ -41,22 +131,79 @@ struct wsi {
   struct xdg_wm_base *wm;
   struct xdg_surface *xdg_surface;
   struct xdg_toplevel *xdg_toplevel;
+  struct wp_presentation *presentation; // NULL if the compositor lacks it.
+  clockid_t presentClock;
+  struct wp_tearing_control_manager_v1 *tearingManager;
+  struct wp_tearing_control_v1 *tearing;
+  struct wp_fifo_manager_v1 *fifoManager;
+  struct wp_fifo_v1 *fifo; // Set when presents queue on the compositor.
+  struct wp_commit_timing_manager_v1 *commitTiming;
+  struct wp_commit_timer_v1 *commitTimer;
+  struct wl_seat *seat;
+  struct wl_pointer *pointer;
+  struct wp_viewporter *viewporter;
+  struct wp_viewport *viewport; // Maps our buffer onto the window's size.
+  struct wp_fractional_scale_manager_v1 *fractionalManager;
+  struct wp_fractional_scale_v1 *fractional;
+  struct wl_subcompositor *subcompositor;
+  struct wp_single_pixel_buffer_manager_v1 *singlePixel;
+  // The toplevel's surface. When the compositor can fill it with our clear
+  // colour from a single pixel buffer, vulkan only draws the middle where the
+  // triangle is, on a subsurface. Otherwise vulkan draws it all and this is
+  // just surface.
+  struct wl_surface *window;
+  struct wl_subsurface *subsurface;
+  struct wp_viewport *windowViewport;
+  struct wl_buffer *background[2]; // Released and pressed colours.
+  struct zwp_linux_dmabuf_v1 *dmabuf; // Version 4 or NULL.
+  struct zwp_linux_dmabuf_feedback_v1 *feedback;
+  struct wl_shm *shm;
+  // Owned by the render thread.
   struct {
     VkSurfaceKHR surface;
     VkSurfaceCapabilitiesKHR surfCaps;
     VkSwapchainKHR swapchain;
     VkFormat swapFormat;
     VkColorSpaceKHR swapSpace;
+    VkPresentModeKHR presentMode;
     uint32_t imgCount;
-    VkImage swapImg[8];
-    VkImageView swapImgView[8];
-    VkFramebuffer fb[8];
+    struct swap_image *img; // imgCount of them, reallocated with the swapchain.
+    int32_t w, h; // What the swapchain is, or is about to be, made at.
     bool recreate;
+    // The window, which the swapchain lags behind while resizing.
+    int32_t winW, winH;
+    uint32_t scale; // Device pixels per window pixel, in 120ths.
+    bool resizing;
+    uint64_t lastRebuild;
+    int32_t viewW, viewH; // Viewport destination we last set, 0 if unset.
+    bool ackPending; // Configure to ack once a commit has the window's size.
+    uint32_t ackSerial;
+    // From dmabuf feedback: the compositor's GPU (0 if unknown) and the
+    // surfaceFormats entries it could scan out from it, a bit each.
+    dev_t mainDevice;
+    uint32_t scanout;
+    bool otherDevice; // We draw on another GPU, its feedback doesn't apply.
+    // With --dmabuf, what it imports from that GPU. Ours to free.
+    struct dmabuf_formats *formats;
+    bool dmabuf; // Presenting our own buffers instead of a swapchain.
   } vk;
 
+  // Owned by the wayland thread, the render thread learns about changes
+  // through the event queue.
   int32_t w, h;
+  uint32_t scale; // Preferred by the compositor, in 120ths.
+  bool resizing;  // The user is dragging a window edge.
+  bool resized;  // Since the last xdg_surface.configure.
+  bool pressed;  // Shown by the background.
   bool window_closed;
-  bool frame_done;
+
+  // Main loop, sleeps on the wayland fd and our timers.
+  int epfd;
+  int statsfd;
+  int sigfd; // SIGUSR1 reports stage timings, SIGINT/SIGTERM close.
+  int inputfd; // Fakes pointer input for --input-rate.
+  bool wantWrite;
+  uint64_t wakeups;
 };
 
 struct vk {
@@ -67,24 +214,517 @@ struct vk {
   VkDevice dev;
   VkQueue gfx;
   VkCommandPool cmdPool;
+  // VK_KHR_present_wait, NULL unless --max-queued is in use.
+  PFN_vkWaitForPresentKHR vkWaitForPresentKHR;
+  // --dmabuf only.
+  PFN_vkGetPhysicalDeviceFormatProperties2KHR
+      vkGetPhysicalDeviceFormatProperties2;
+  PFN_vkGetImageDrmFormatModifierPropertiesEXT
+      vkGetImageDrmFormatModifierPropertiesEXT;
+  PFN_vkGetMemoryFdKHR vkGetMemoryFdKHR;
+  PFN_vkGetSemaphoreFdKHR vkGetSemaphoreFdKHR;
+  PFN_vkImportSemaphoreFdKHR vkImportSemaphoreFdKHR;
+  // Vulkan 1.1 or VK_KHR_dedicated_allocation, else NULL.
+  PFN_vkGetBufferMemoryRequirements2KHR vkGetBufferMemoryRequirements2;
+  PFN_vkGetImageMemoryRequirements2KHR vkGetImageMemoryRequirements2;
+  // vk_memory_alloc's blocks by memory type, linear resources and optimal
+  // images apart so bufferImageGranularity never comes into it.
+  struct vk_block *pools[VK_MAX_MEMORY_TYPES][2];
+  // Live vkAllocateMemory calls of ours and the most there have been.
+  uint32_t allocations, peakAllocations;
+  // What the blocks hold: resources placed in them, and bytes.
+  uint32_t blocks, ranges;
+  VkDeviceSize blockBytes, rangeBytes;
+};
+
+// Events from the wayland thread to the render thread.
+enum render_event_type {
+  EV_RESIZE,
+  EV_FRAME,
+  EV_PRESENTED,
+  EV_FEEDBACK,
+  EV_RELEASE,
+  EV_CLOSE,
+};
+
+struct render_event {
+  enum render_event_type type;
+  int32_t w, h;
+  uint32_t scale;
+  bool resizing;
+  // EV_RESIZE: the configure for the render thread to ack with its first
+  // commit at this size, when ack is set.
+  bool ack;
+  uint32_t serial;
+  // EV_PRESENTED: which frame, when it hit the screen on CLOCK_MONOTONIC (0 if
+  // it was discarded) and the output's refresh interval in ns. EV_RELEASE:
+  // the buffer's pool generation << 8 | its index.
+  uint64_t id, time;
+  uint32_t refresh;
+  // EV_FEEDBACK: surfaceFormats entries the compositor can scan out and, with
+  // --dmabuf, all it imports from the main device for the render thread to
+  // keep.
+  uint32_t scanout;
+  struct dmabuf_formats *formats;
+};
+
+// Single producer (wayland thread), single consumer (render thread) ring.
+// Power of two so the free running indices wrap cleanly.
+#define EVENT_QUEUE_SIZE 64
+struct event_queue {
+  struct render_event ev[EVENT_QUEUE_SIZE];
+  _Atomic uint32_t head; // Next slot to write, advanced by the producer.
+  _Atomic uint32_t tail; // Next slot to read, advanced by the consumer.
+  int efd;               // Signalled on push so the consumer can sleep.
+};
+
+// Everything one frame in flight needs which must not be touched by the CPU
+// until its fence signals.
+#define MAX_FRAMES_IN_FLIGHT 4
+struct frame {
+  VkCommandBuffer cmd;
+  VkSemaphore imageAvailable;
+  VkFence inFlight;
+  VkDescriptorSet descSet;
+  void *matrix; // This frame's slice of the persistently mapped matrixBuffer.
+  uint64_t id;  // Frame last recorded into this slot.
+  uint32_t query; // First of this frame's pair of timestamp queries.
+  bool timed;     // The queries hold results from the last submit.
+  float scale;    // Of the swapchain's size the last frame here was drawn at.
+  // Drawn into below full size and blitted to the swapchain image with
+  // --dynamic-res. Swapchain sized, only the top left corner is used.
+  VkImage scene;
+  struct vk_alloc sceneAlloc;
+  VkImageView sceneView;
+  VkFramebuffer sceneFb;
+};
+
+// Objects an earlier frame or its present may still be using. Each is tagged
+// with the id of the first frame recorded after it was replaced and destroyed
+// once every frame before that one is known to be done. Frame fences don't
+// cover presents, what those use is also tagged with the first present after
+// it and waits for that to be acquired back.
+enum retired_type {
+  RETIRED_FRAMEBUFFER,
+  RETIRED_IMAGE_VIEW,
+  RETIRED_IMAGE,
+  RETIRED_MEMORY,
+  RETIRED_ALLOCATION,
+  RETIRED_SEMAPHORE,
+  RETIRED_SWAPCHAIN,
+  RETIRED_PIPELINE,
+  RETIRED_RENDER_PASS,
+};
+
+struct retired {
+  enum retired_type type;
+  union {
+    VkFramebuffer fb;
+    VkImageView view;
+    VkImage image;
+    VkDeviceMemory mem;
+    struct vk_alloc alloc;
+    VkSemaphore semaphore;
+    VkSwapchainKHR swapchain;
+    VkPipeline pipeline;
+    VkRenderPass renderPass;
+  };
+  uint64_t frame;
+  uint64_t present; // 0 unless a present waits on it.
+};
+
+// Tags only grow so this is a plain fifo. Presents only come back once a
+// swapchain lives long enough to reuse an image, recreate_swapchain waits for
+// the queue before a steady stream of resizes fills it.
+#define RETIRE_QUEUE_SIZE 256
+struct retire_queue {
+  struct retired r[RETIRE_QUEUE_SIZE];
+  uint32_t head, tail;
+};
+
+// Recent costs, the scheduler budgets for the worst of them.
+#define COST_HISTORY 32
+struct cost_history {
+  uint64_t ns[COST_HISTORY];
+  uint32_t count;
+};
+
+// Frame pacing from presentation feedback, owned by the render thread. All
+// times are CLOCK_MONOTONIC ns.
+#define PACE_TARGETS 16
+struct pace {
+  bool enabled;
+  int timerfd; // Wakes the render thread when the next frame should start.
+  bool due;    // Start a frame now.
+  uint64_t lastPresent;
+  uint32_t refresh; // 0 until the compositor tells us.
+  uint64_t target;  // Vblank the next frame aims for.
+  uint64_t wake;    // When the next frame starts.
+  uint64_t lastTarget;
+  uint64_t targets[PACE_TARGETS]; // By frame id, to spot misses.
+  struct cost_history cpu; // Frame start until its commit is out.
+  struct cost_history gpu; // Timestamp queries around the command buffer.
+  uint64_t presented, discarded, missed, skipped;
+};
+
+// Without frame callbacks (hidden, minimized, some compositors when occluded)
+// only draw this often so the app stays responsive without burning the GPU.
+#define FRAME_FALLBACK_NS 1000000000ull
+
+struct render {
+  pthread_t thread;
+  struct event_queue queue;
+  int epfd;
+  int fallbackfd; // Armed at each commit, disarmed by its frame callback.
+  bool frame_done; // The compositor wants a new frame.
+  bool uncapped;   // Draw flat out while the compositor is showing us.
+  uint64_t lastCallback;
+  uint32_t queued; // Commits waiting behind the compositor's fifo barrier.
+  bool timestampPending; // Set on the surface but not committed yet.
+
+  // Present ids for --max-queued.
+  uint64_t presentId;   // Last id handed to vkQueuePresentKHR.
+  uint64_t swapFirstId; // First id presented to the current swapchain.
+  uint64_t depthSum, depthMax, depthSamples, waitTimeouts;
+  // Every vkQueuePresentKHR, and the last one known to be done with what it
+  // waited on: an image it presented has been acquired again.
+  uint64_t presents, presentsDone;
+  bool quit;
+  _Atomic uint64_t drawn;
+  uint64_t dispatchNs; // Handling events since the last frame.
+
+  // Input the next frame draws, set by the wayland thread as it arrives and
+  // taken by the render thread as it records.
+  _Atomic uint64_t inputArrival; // Earliest not yet drawn, 0 for none.
+  _Atomic uint64_t inputSeq;     // Inputs so far.
+  _Atomic bool pressed;          // A pointer button is down.
+
+  struct frame frame[MAX_FRAMES_IN_FLIGHT];
+  uint32_t frameCount; // How many of frame[] are in use.
+  struct retire_queue retired;
+};
+
+// CPU time spent in each part of a frame on the render thread.
+enum stage {
+  STAGE_DISPATCH,
+  STAGE_FENCE,
+  STAGE_ACQUIRE,
+  STAGE_RECORD,
+  STAGE_SUBMIT,
+  STAGE_PRESENT,
+  STAGE_COUNT,
+};
+
+static const char *stageNames[STAGE_COUNT] = {
+    "dispatch", "fence", "acquire", "record", "submit", "present",
+};
+
+// The last STAGE_RING_SIZE frames. Written only by the render thread, which
+// never waits on readers, so a reader checks seq to spot entries that were
+// overwritten while it copied them.
+#define STAGE_RING_SIZE 4096
+struct stage_sample {
+  _Atomic uint64_t seq; // Frame number + 1 once complete, 0 while written.
+  uint64_t start;       // CLOCK_MONOTONIC ns.
+  uint64_t ns[STAGE_COUNT];
+};
+
+struct stage_ring {
+  struct stage_sample s[STAGE_RING_SIZE];
+  _Atomic uint64_t head; // Frames written.
+};
+
+// Dynamic resolution, owned by the render thread. Frames are drawn at scale
+// times the swapchain's size per axis, picked from what the GPU took.
+struct dynres {
+  bool enabled; // Asked for and the swapchain can be blitted to.
+  float scale;
+  uint32_t frames; // Since the last adjustment.
+  uint64_t worst;  // GPU ns of those frames, as if drawn at full size.
+  uint32_t changes;
+  float lowest;
+};
+
+// Damage tracking, owned by the render thread. The scene is a clear colour
+// and a triangle, so what changed is where the triangle was and is now.
+struct damage {
+  bool incremental; // VK_KHR_incremental_present, the WSI damages less.
+  bool valid;       // The last present was drawn at full size.
+  bool pressed;     // Its clear colour.
+  VkRect2D box;     // Its triangle.
+  uint64_t drawn, total; // Pixels redrawn, and what full frames would have.
+};
+
+// Input to photon latency, owned by the render thread. Frames are matched
+// to their presentation feedback by id like the pacer's targets.
+#define LATENCY_SAMPLES 4096
+struct latency {
+  uint64_t frame[PACE_TARGETS];   // Whose slot it is, uncapped laps it.
+  uint64_t arrival[PACE_TARGETS]; // Oldest input each frame drew.
+  uint64_t inputs[PACE_TARGETS];  // How many inputs each frame drew.
+  uint64_t lastSeq;
+  uint64_t ns[LATENCY_SAMPLES]; // Arrival until on screen, the last ones.
+  uint32_t count;
+  uint64_t drawn, discarded; // Inputs, and those whose frame never showed.
+};
+
+// linux-dmabuf feedback as it arrives, owned by the wayland thread. Each
+// batch of events ends with done, the render thread only hears about those.
+struct format_table_entry {
+  uint32_t format;
+  uint32_t pad;
+  uint64_t modifier;
+};
+
+// Table entries in any of surfaceFormats' formats.
+struct dmabuf_formats {
+  uint32_t count;
+  struct format_table_entry entry[];
+};
+
+struct feedback {
+  const struct format_table_entry *table; // mmaped, the last one sent.
+  uint32_t tableSize;                     // In entries.
+  dev_t mainDevice;
+  dev_t trancheDevice;
+  uint32_t trancheFormats; // surfaceFormats entries, a bit each.
+  bool trancheScanout;
+  uint32_t scanout; // Of this batch's tranches targeting the main device.
+  uint32_t sent;    // What the render thread has.
+  // --dmabuf only, the entries of this tranche and of this batch's tranches
+  // targeting the main device.
+  struct dmabuf_formats *trancheEntries, *entries;
+};
+
+// Presenting our own buffers with --dmabuf, owned by the render thread. The
+// pool is WSI.vk.img, each image exported and wrapped in a wl_buffer which is
+// only drawn to again once the compositor releases it.
+#define DMABUF_MODIFIERS 64
+#define DMABUF_MAX_BUFFERS 8
+struct dmabuf {
+  int32_t format; // surfaceFormats entry of the pool.
+  uint64_t modifiers[DMABUF_MODIFIERS]; // Both we and the compositor take.
+  uint32_t modifierCount;
+  uint64_t modifier;   // The driver's pick among them.
+  uint32_t generation; // Of the pool, releases from older ones are stale.
+  bool busy[DMABUF_MAX_BUFFERS]; // Attached until the compositor releases it.
+  // The kernel takes our render fence and hands back the compositor's as
+  // sync_files, else commits wait for the GPU.
+  bool syncFile;
+  uint64_t exhausted; // Times the compositor held every buffer.
+};
+
+// --cpu splits each frame into square tiles which the render thread and its
+// workers take one at a time, small enough to balance, big enough that the
+// per tile setup is noise.
+#define RASTER_TILE 64
+#define RASTER_MAX_THREADS 16
+// Keeps a pool of SHM_BUFFERS under wl_shm's 2GB.
+#define RASTER_MAX_EXTENT 8192
+
+// A x + B y + C, positive inside the triangle.
+struct raster_edge {
+  float a, b, c;
+  bool topLeft; // Pixel centres exactly on it are inside.
+};
+
+struct raster {
+  pthread_t thread[RASTER_MAX_THREADS];
+  uint32_t threadCount; // Workers besides the render thread.
+  pthread_mutex_t lock;
+  pthread_cond_t start, done;
+  uint64_t job;    // Bumped for every frame.
+  bool quit;       // Workers exit instead of taking the next job.
+  uint32_t active; // Workers still on the current one.
+  _Atomic uint32_t nextTile;
+  uint8_t srgb[4096]; // Linear 12 bit to sRGB 8 bit.
+
+  // The frame, only written while the workers are idle.
+  uint32_t *pixels;
+  int32_t w, h;
+  uint32_t tilesX, tileCount;
+  uint32_t clear;
+  struct raster_edge edge[3];
+  // Vertex colours over the area, summed with the edge functions opposite
+  // them they interpolate.
+  float col[3][3];
+  int32_t x0, y0, x1, y1; // Pixels the triangle may touch, x1 y1 exclusive.
+};
+
+// wl_shm buffers for --cpu, all in one memfd.
+#define SHM_BUFFERS 3
+struct shm {
+  struct {
+    struct wl_buffer *buffer;
+    uint32_t *pixels;
+  } buf[SHM_BUFFERS];
+  bool busy[SHM_BUFFERS]; // Attached until the compositor releases it.
+  void *data;
+  size_t size;
+  int32_t w, h;
+  uint32_t generation; // Of the pool, releases from older ones are stale.
+  uint64_t exhausted;  // Times the compositor held every buffer.
+};
+
+// Bits per colour channel of the swapchain.
+enum surface_depth {
+  DEPTH_8,
+  DEPTH_10,
+  DEPTH_16F,
+};
+
+// Where frames go.
+enum backend {
+  BACKEND_WAYLAND,
+  BACKEND_HEADLESS, // Offscreen images, no compositor needed.
+  BACKEND_DMABUF,   // Our own buffers instead of a swapchain.
+};
+
+// Headless benchmark samples, one per frame.
+struct bench {
+  uint64_t *interval; // Submit to submit, what the throughput is made of.
+  uint64_t *cpu;      // Frame start until its submit returned.
+  uint64_t *gpu;
+  uint32_t frames, gpuFrames;
+  uint64_t start, lastSubmit;
+};
+
+struct options {
+  bool loop_stats;
+  uint32_t frames_in_flight;
+  bool no_pace;
+  uint64_t pace_margin; // Slack left for the compositor before the vblank.
+  VkPresentModeKHR present_mode;
+  uint32_t max_queued; // Presents allowed to wait for display, 0 for any.
+  bool tearing;
+  bool scheduled;
+  enum backend backend;
+  uint32_t headless_frames;
+  bool stage_stats;
+  const char *stage_json; // Raw samples go here with every report.
+  uint32_t input_rate;    // Synthetic inputs per second.
+  double render_scale;    // Share of the device pixels we draw.
+  bool dynamic_res;
+  bool no_damage;
+  enum surface_depth surface_depth;
+  uint32_t dmabuf_buffers;
+  bool cpu; // Rasterize into wl_shm buffers, or memory when headless.
+};
+
+static const struct {
+  const char *name;
+  VkPresentModeKHR mode;
+} presentModeNames[] = {
+    {"fifo", VK_PRESENT_MODE_FIFO_KHR},
+    {"relaxed", VK_PRESENT_MODE_FIFO_RELAXED_KHR},
+    {"mailbox", VK_PRESENT_MODE_MAILBOX_KHR},
+    {"immediate", VK_PRESENT_MODE_IMMEDIATE_KHR},
+};
+
+static const char *surfaceDepthNames[] = {"8bit", "10bit", "fp16"};
+
+// Formats we know how to draw to, preferred first within each depth. 8 bit
+// BGRA is what every compositor and display engine scans out without a
+// conversion. 10 bit costs the same bandwidth but not every plane takes it,
+// fp16 doubles the bandwidth and is normally composited, so both are opt in.
+// The sRGB formats encode our linear output themselves, for the others shown
+// as sRGB the fragment shader and clear colour do it.
+// drm is the fourcc the WSI shares an opaque swapchain's images as, which
+// is what dmabuf feedback lists and what --dmabuf makes its buffers in.
+static const struct {
+  VkFormat format;
+  VkColorSpaceKHR space;
+  enum surface_depth depth;
+  const char *name;
+  uint32_t drm;
+} surfaceFormats[] = {
+    {VK_FORMAT_B8G8R8A8_SRGB, VK_COLOR_SPACE_SRGB_NONLINEAR_KHR, DEPTH_8,
+     "bgra8 srgb", FOURCC('X', 'R', '2', '4')},
+    {VK_FORMAT_R8G8B8A8_SRGB, VK_COLOR_SPACE_SRGB_NONLINEAR_KHR, DEPTH_8,
+     "rgba8 srgb", FOURCC('X', 'B', '2', '4')},
+    {VK_FORMAT_A2R10G10B10_UNORM_PACK32, VK_COLOR_SPACE_SRGB_NONLINEAR_KHR,
+     DEPTH_10, "a2rgb10", FOURCC('X', 'R', '3', '0')},
+    {VK_FORMAT_A2B10G10R10_UNORM_PACK32, VK_COLOR_SPACE_SRGB_NONLINEAR_KHR,
+     DEPTH_10, "a2bgr10", FOURCC('X', 'B', '3', '0')},
+    {VK_FORMAT_R16G16B16A16_SFLOAT, VK_COLOR_SPACE_EXTENDED_SRGB_LINEAR_EXT,
+     DEPTH_16F, "rgba16f scrgb", FOURCC('X', 'B', '4', 'H')},
+    {VK_FORMAT_R16G16B16A16_SFLOAT, VK_COLOR_SPACE_SRGB_NONLINEAR_KHR,
+     DEPTH_16F, "rgba16f", FOURCC('X', 'B', '4', 'H')},
+    {VK_FORMAT_B8G8R8A8_UNORM, VK_COLOR_SPACE_SRGB_NONLINEAR_KHR, DEPTH_8,
+     "bgra8 unorm", FOURCC('X', 'R', '2', '4')},
+    {VK_FORMAT_R8G8B8A8_UNORM, VK_COLOR_SPACE_SRGB_NONLINEAR_KHR, DEPTH_8,
+     "rgba8 unorm", FOURCC('X', 'B', '2', '4')},
+};
+
+// Linear, pressed pointer buttons tint the window.
+static const float clearColors[2][4] = {
+    {0.2f, 0.4f, 0.9f, 1.0f},
+    {0.9f, 0.4f, 0.2f, 1.0f},
+};
+
+// What the sRGB formats and the display make of our linear colours.
+float srgb_encode(float linear) {
+  return linear <= 0.0031308f ? linear * 12.92f
+                              : 1.055f * powf(linear, 1 / 2.4f) - 0.055f;
+}
+
+// The triangle never leaves the middle 1/sqrt(2) of the window, a subsurface
+// this share of it each way has room to spare.
+#define CONTENT_SHARE 0.75
+
+// Representation of the packed vertex stage input for use in configuring
+// shader input. Also VUID-VkVertexInputBindingDescription-stride-04456
+// --cpu draws the same, colours are linear there too.
+struct VData {
+  struct {
+    float p1;
+    float p2;
+  } pos;
+  struct {
+    float c1;
+    float c2;
+    float c3;
+  } col;
+};
+static const struct VData vertexIn[3] = {
+    {{0.0f, -0.5f}, {1.0f, 0.0f, 0.0f}},
+    {{0.5f, 0.5f}, {0.0f, 1.0f, 0.0f}},
+    {{-0.5f, 0.5f}, {0.0f, 0.0f, 1.0f}},
+};
+struct MData {
+  float m[16];
 };
 
 struct wsi WSI = {0};
 struct vk VK = {0};
+struct render RENDER = {0};
+struct pace PACE = {0};
+struct bench BENCH = {0};
+struct stage_ring STAGES = {0};
+struct latency LATENCY = {0};
+struct dynres DYNRES = {.scale = 1.0f, .lowest = 1.0f};
+struct damage DAMAGE = {0};
+struct feedback FEEDBACK = {0};
+struct dmabuf DMABUF = {0};
+struct raster RASTER = {0};
+struct shm SHM = {0};
+struct options OPTS = {.frames_in_flight = 2,
+                       .pace_margin = 2000000,
+                       .present_mode = VK_PRESENT_MODE_FIFO_KHR,
+                       .render_scale = 1.0};
 VkExtensionProperties vkExtensions[64] = {0};
+VkExtensionProperties vkDeviceExtensions[256] = {0};
 
 struct vk_buffer {
   VkBufferCreateInfo ci;
   VkBuffer buf;
-  VkDeviceSize alloc_size;
-  int32_t memTypeIdx;
-  VkDeviceMemory mem;
+  struct vk_alloc alloc;
 };
 
 VkExtent2D swapSize() {
-  return (VkExtent2D){CLAMP(WSI.w, WSI.vk.surfCaps.minImageExtent.width,
+  return (VkExtent2D){CLAMP(WSI.vk.w, WSI.vk.surfCaps.minImageExtent.width,
                             WSI.vk.surfCaps.maxImageExtent.width),
-                      CLAMP(WSI.h, WSI.vk.surfCaps.minImageExtent.height,
+                      CLAMP(WSI.vk.h, WSI.vk.surfCaps.minImageExtent.height,
                             WSI.vk.surfCaps.maxImageExtent.height)};
 }
 
@@ -100,6 +740,257 @@ int32_t findMemoryIdx(VkPhysicalDeviceMemoryProperties memories,
   return -1;
 }
 
+// Memory
+
+// Resources are placed in big blocks of memory rather than getting an
+// allocation each: drivers cap those at maxMemoryAllocationCount, as low as
+// 4096, and each is a trip to the kernel. A block splits in halves down to
+// VK_ALLOC_MIN, so a range of order k is VK_ALLOC_MIN << k at a multiple of
+// that which covers any alignment up to its size, and a freed range merges
+// back with its other half, its buddy, whenever that is free too. Ranges are
+// looked up by their first unit, so finding the buddy is a single load.
+#define VK_ALLOC_MIN 256ull
+#define VK_ALLOC_ORDERS 18
+#define VK_ALLOC_BLOCK (VK_ALLOC_MIN << (VK_ALLOC_ORDERS - 1)) // 32MB
+// A pool's first block is 1MB, so a few small buffers don't tie up a whole
+// VK_ALLOC_BLOCK. Each block added to it is twice the size, up to that.
+#define VK_ALLOC_FIRST_ORDER 12
+// Above this a resource gets its own allocation, so one big image doesn't
+// keep a block of otherwise free memory alive.
+#define VK_ALLOC_DEDICATED (VK_ALLOC_BLOCK / 8)
+
+struct vk_block {
+  VkDeviceMemory mem;
+  void *mapped; // All of it, for as long as it lives, if host visible.
+  struct vk_block **pool;
+  struct vk_block *next;
+  uint32_t top; // The block's own order, it is VK_ALLOC_MIN << top.
+  // Free ranges of each order by offset, in units of VK_ALLOC_MIN.
+  uint32_t *free[VK_ALLOC_ORDERS];
+  uint32_t freeCount[VK_ALLOC_ORDERS], freeCap[VK_ALLOC_ORDERS];
+  // By unit, for the free range starting there: 1 + its order, else 0, and
+  // where it is in free[order].
+  uint8_t *freeOrder;
+  uint32_t *freeSlot;
+};
+
+// Every vkAllocateMemory of ours, counted against maxMemoryAllocationCount.
+VkDeviceMemory vk_allocate(const VkMemoryAllocateInfo *info) {
+  VkDeviceMemory mem;
+  VkResult result = vkAllocateMemory(VK.dev, info, NULL, &mem);
+  assert(result == VK_SUCCESS);
+  VK.allocations++;
+  VK.peakAllocations = MAX(VK.peakAllocations, VK.allocations);
+  return mem;
+}
+
+void vk_free(VkDeviceMemory mem) {
+  vkFreeMemory(VK.dev, mem, NULL);
+  VK.allocations--;
+}
+
+void vk_memory_stats(uint32_t max) {
+  printf("memory: %u resources in %u blocks, %" PRIu64 "KB of %" PRIu64
+         "KB used, %u allocations, at most %u of %u allowed\n",
+         VK.ranges, VK.blocks, (uint64_t)(VK.rangeBytes + 1023) / 1024,
+         (uint64_t)VK.blockBytes / 1024, VK.allocations, VK.peakAllocations,
+         max);
+}
+
+void vk_block_push(struct vk_block *b, uint32_t order, uint32_t offset) {
+  if (b->freeCount[order] == b->freeCap[order]) {
+    b->freeCap[order] = MAX(b->freeCap[order] * 2, 8);
+    b->free[order] =
+        realloc(b->free[order], b->freeCap[order] * sizeof(uint32_t));
+    assert(b->free[order]);
+  }
+  b->freeOrder[offset] = order + 1;
+  b->freeSlot[offset] = b->freeCount[order];
+  b->free[order][b->freeCount[order]++] = offset;
+}
+
+// Take offset off the order's free list, false if it isn't on it.
+bool vk_block_take(struct vk_block *b, uint32_t order, uint32_t offset) {
+  if (b->freeOrder[offset] != order + 1)
+    return false;
+  uint32_t last = b->free[order][--b->freeCount[order]];
+  b->free[order][b->freeSlot[offset]] = last;
+  b->freeSlot[last] = b->freeSlot[offset];
+  b->freeOrder[offset] = 0;
+  return true;
+}
+
+// A free range of order, split off the smallest larger one if need be.
+// UINT32_MAX if the block has none.
+uint32_t vk_block_alloc(struct vk_block *b, uint32_t order) {
+  uint32_t from = order;
+  while (from <= b->top && !b->freeCount[from])
+    from++;
+  if (from > b->top)
+    return UINT32_MAX;
+  uint32_t offset = b->free[from][b->freeCount[from] - 1];
+  vk_block_take(b, from, offset);
+  // Keep the lower half, the upper is free at the order below.
+  while (from > order) {
+    from--;
+    vk_block_push(b, from, offset + (1u << from));
+  }
+  return offset;
+}
+
+// A block of VK_ALLOC_MIN << order bytes, added to pool.
+struct vk_block *vk_block_new(struct vk_block **pool, uint32_t type,
+                              uint32_t order) {
+  struct vk_block *b = calloc(1, sizeof(*b));
+  assert(b);
+  b->top = order;
+  uint32_t units = 1u << order;
+  b->freeOrder = calloc(units, sizeof(*b->freeOrder));
+  b->freeSlot = calloc(units, sizeof(*b->freeSlot));
+  assert(b->freeOrder && b->freeSlot);
+  VkMemoryAllocateInfo allocInfo = {0};
+  allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+  allocInfo.allocationSize = VK_ALLOC_MIN << order;
+  allocInfo.memoryTypeIndex = type;
+  b->mem = vk_allocate(&allocInfo);
+  VK.blocks++;
+  VK.blockBytes += allocInfo.allocationSize;
+  if (VK.pmem.memoryTypes[type].propertyFlags &
+      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+    VkResult result =
+        vkMapMemory(VK.dev, b->mem, 0, VK_WHOLE_SIZE, 0, &b->mapped);
+    assert(result == VK_SUCCESS);
+  }
+  vk_block_push(b, order, 0);
+  b->pool = pool;
+  b->next = *pool;
+  *pool = b;
+  return b;
+}
+
+// Memory for either a buffer or an optimally tiled image. Host visible memory
+// comes mapped.
+struct vk_alloc vk_memory_alloc(VkBuffer buffer, VkImage image,
+                                VkMemoryPropertyFlags properties) {
+  // Where it can, the driver says whether the resource is better off with an
+  // allocation of its own, render targets often are.
+  VkMemoryRequirements reqs;
+  VkMemoryDedicatedRequirements dedicatedReqs = {0};
+  dedicatedReqs.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS;
+  VkMemoryRequirements2 reqs2 = {0};
+  reqs2.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+  reqs2.pNext = &dedicatedReqs;
+  if (!VK.vkGetImageMemoryRequirements2) {
+    if (buffer)
+      vkGetBufferMemoryRequirements(VK.dev, buffer, &reqs);
+    else
+      vkGetImageMemoryRequirements(VK.dev, image, &reqs);
+  } else if (buffer) {
+    VkBufferMemoryRequirementsInfo2 info = {0};
+    info.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_REQUIREMENTS_INFO_2;
+    info.buffer = buffer;
+    VK.vkGetBufferMemoryRequirements2(VK.dev, &info, &reqs2);
+    reqs = reqs2.memoryRequirements;
+  } else {
+    VkImageMemoryRequirementsInfo2 info = {0};
+    info.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_REQUIREMENTS_INFO_2;
+    info.image = image;
+    VK.vkGetImageMemoryRequirements2(VK.dev, &info, &reqs2);
+    reqs = reqs2.memoryRequirements;
+  }
+
+  int32_t type = findMemoryIdx(VK.pmem, reqs.memoryTypeBits, properties);
+  assert(type != -1);
+  bool mappable = VK.pmem.memoryTypes[type].propertyFlags &
+                  VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+  struct vk_alloc a = {0};
+  VkDeviceSize size = MAX(reqs.size, reqs.alignment);
+  if (size > VK_ALLOC_DEDICATED ||
+      dedicatedReqs.requiresDedicatedAllocation ||
+      dedicatedReqs.prefersDedicatedAllocation) {
+    VkMemoryDedicatedAllocateInfo dedicated = {0};
+    dedicated.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO;
+    dedicated.buffer = buffer;
+    dedicated.image = image;
+    VkMemoryAllocateInfo allocInfo = {0};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    if (VK.vkGetImageMemoryRequirements2)
+      allocInfo.pNext = &dedicated;
+    allocInfo.allocationSize = reqs.size;
+    allocInfo.memoryTypeIndex = type;
+    a.mem = vk_allocate(&allocInfo);
+    if (mappable) {
+      VkResult result =
+          vkMapMemory(VK.dev, a.mem, 0, VK_WHOLE_SIZE, 0, &a.mapped);
+      assert(result == VK_SUCCESS);
+    }
+    return a;
+  }
+
+  while (VK_ALLOC_MIN << a.order < size)
+    a.order++;
+  struct vk_block **pool = &VK.pools[type][!buffer];
+  uint32_t offset = UINT32_MAX, blocks = 0;
+  for (a.block = *pool; a.block; a.block = a.block->next, blocks++) {
+    offset = vk_block_alloc(a.block, a.order);
+    if (offset != UINT32_MAX)
+      break;
+  }
+  if (!a.block) {
+    uint32_t order = MIN(VK_ALLOC_FIRST_ORDER + blocks, VK_ALLOC_ORDERS - 1);
+    a.block = vk_block_new(pool, type, MAX(order, a.order));
+    offset = vk_block_alloc(a.block, a.order);
+  }
+  VK.ranges++;
+  VK.rangeBytes += VK_ALLOC_MIN << a.order;
+  a.mem = a.block->mem;
+  a.offset = offset * VK_ALLOC_MIN;
+  if (a.block->mapped)
+    a.mapped = (char *)a.block->mapped + a.offset;
+  return a;
+}
+
+// Give a's range back to its block, merging it with its buddy for as long as
+// that is free. A block which ends up empty is kept as its pool's spare, so
+// churn across a block boundary doesn't go to the driver every time, and
+// freed if there already is one.
+void vk_memory_free(struct vk_alloc a) {
+  if (!a.block) {
+    vk_free(a.mem);
+    return;
+  }
+  struct vk_block *b = a.block;
+  VK.ranges--;
+  VK.rangeBytes -= VK_ALLOC_MIN << a.order;
+  uint32_t offset = a.offset / VK_ALLOC_MIN, order = a.order;
+  while (order < b->top &&
+         vk_block_take(b, order, offset ^ (1u << order))) {
+    offset &= ~(1u << order);
+    order++;
+  }
+  vk_block_push(b, order, offset);
+
+  if (order < b->top)
+    return;
+  struct vk_block *spare = *b->pool;
+  while (spare && (spare == b || !spare->freeCount[spare->top]))
+    spare = spare->next;
+  if (!spare)
+    return;
+  struct vk_block **link = b->pool;
+  while (*link != b)
+    link = &(*link)->next;
+  *link = b->next;
+  vk_free(b->mem);
+  VK.blocks--;
+  VK.blockBytes -= VK_ALLOC_MIN << b->top;
+  for (uint32_t i = 0; i < VK_ALLOC_ORDERS; i++)
+    free(b->free[i]);
+  free(b->freeOrder);
+  free(b->freeSlot);
+  free(b);
+}
+
 struct vk_buffer vk_buffer_new(VkDeviceSize size, VkBufferUsageFlags usage,
                                VkMemoryPropertyFlags properties) {
 
@@ -112,26 +1003,464 @@ struct vk_buffer vk_buffer_new(VkDeviceSize size, VkBufferUsageFlags usage,
   VkResult result = vkCreateBuffer(VK.dev, &b.ci, NULL, &b.buf);
   assert(result == VK_SUCCESS);
 
-  VkMemoryRequirements reqs;
-  vkGetBufferMemoryRequirements(VK.dev, b.buf, &reqs);
+  b.alloc = vk_memory_alloc(b.buf, VK_NULL_HANDLE, properties);
+  vkBindBufferMemory(VK.dev, b.buf, b.alloc.mem, b.alloc.offset);
 
-  b.alloc_size = reqs.size;
-  b.memTypeIdx = findMemoryIdx(VK.pmem, reqs.memoryTypeBits,
-                               VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-                                   VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-  assert(b.memTypeIdx > -1);
+  return b;
+}
 
-  VkMemoryAllocateInfo allocInfo = {0};
-  allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-  allocInfo.allocationSize = b.alloc_size;
-  allocInfo.memoryTypeIndex = b.memTypeIdx;
+bool vk_has_extension(const VkExtensionProperties *exts, uint32_t count,
+                      const char *name) {
+  for (uint32_t i = 0; i < count; i++) {
+    if (strcmp(exts[i].extensionName, name) == 0)
+      return true;
+  }
+  return false;
+}
 
-  result = vkAllocateMemory(VK.dev, &allocInfo, NULL, &b.mem);
-  assert(result == VK_SUCCESS);
+// Event loop helpers
 
-  vkBindBufferMemory(VK.dev, b.buf, b.mem, 0);
+uint64_t now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
 
-  return b;
+int timer_new() {
+  int fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+  assert(fd != -1);
+  return fd;
+}
+
+// Fire once at the absolute CLOCK_MONOTONIC time `at` then every `interval`
+// ns, if non-zero. An `at` of 0 disarms the timer.
+void timer_arm(int fd, uint64_t at, uint64_t interval) {
+  struct itimerspec its = {0};
+  its.it_value.tv_sec = at / 1000000000ull;
+  its.it_value.tv_nsec = at % 1000000000ull;
+  its.it_interval.tv_sec = interval / 1000000000ull;
+  its.it_interval.tv_nsec = interval % 1000000000ull;
+  timerfd_settime(fd, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
+// Expirations since the last drain, 0 if it has not fired.
+uint64_t timer_drain(int fd) {
+  uint64_t n = 0;
+  if (read(fd, &n, sizeof(n)) != sizeof(n))
+    return 0;
+  return n;
+}
+
+void epoll_watch(int epfd, int fd, uint32_t events) {
+  struct epoll_event ev = {0};
+  ev.events = events;
+  ev.data.fd = fd;
+  int ret = epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+  assert(ret == 0);
+}
+
+bool queue_push(struct event_queue *q, struct render_event ev) {
+  uint32_t head = atomic_load_explicit(&q->head, memory_order_relaxed);
+  uint32_t tail = atomic_load_explicit(&q->tail, memory_order_acquire);
+  if (head - tail == EVENT_QUEUE_SIZE)
+    return false;
+
+  q->ev[head % EVENT_QUEUE_SIZE] = ev;
+  atomic_store_explicit(&q->head, head + 1, memory_order_release);
+  eventfd_write(q->efd, 1);
+  return true;
+}
+
+bool queue_pop(struct event_queue *q, struct render_event *ev) {
+  uint32_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+  uint32_t head = atomic_load_explicit(&q->head, memory_order_acquire);
+  if (head == tail)
+    return false;
+
+  *ev = q->ev[tail % EVENT_QUEUE_SIZE];
+  atomic_store_explicit(&q->tail, tail + 1, memory_order_release);
+  return true;
+}
+
+// Hand an event to the render thread. Frame and presentation events are only
+// hints and may be dropped, the rest must arrive so wait out a render thread
+// stuck presenting.
+void render_send(struct render_event ev) {
+  while (!queue_push(&RENDER.queue, ev)) {
+    if (ev.type == EV_FRAME || ev.type == EV_PRESENTED)
+      return;
+    sched_yield();
+  }
+}
+
+// Input for the render thread, pointer events and --input-rate both land
+// here. Timed on arrival as the events' own times have no defined clock.
+void input_arrived() {
+  uint64_t none = 0;
+  atomic_compare_exchange_strong(&RENDER.inputArrival, &none, now_ns());
+  atomic_fetch_add(&RENDER.inputSeq, 1);
+}
+
+// Stage timings
+
+int cmp_u64(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+  return x < y ? -1 : x > y;
+}
+
+// Nearest rank, v must be sorted.
+uint64_t percentile(const uint64_t *v, uint32_t n, double p) {
+  uint32_t rank = (uint32_t)ceil(p / 100.0 * n);
+  return v[rank ? rank - 1 : 0];
+}
+
+// Time since *t, moving *t up to now.
+uint64_t stage_lap(uint64_t *t) {
+  uint64_t now = now_ns(), d = now - *t;
+  *t = now;
+  return d;
+}
+
+void stage_push(uint64_t start, const uint64_t ns[STAGE_COUNT]) {
+  uint64_t head = atomic_load_explicit(&STAGES.head, memory_order_relaxed);
+  struct stage_sample *s = &STAGES.s[head % STAGE_RING_SIZE];
+  atomic_store_explicit(&s->seq, 0, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+  s->start = start;
+  memcpy(s->ns, ns, sizeof(s->ns));
+  atomic_store_explicit(&s->seq, head + 1, memory_order_release);
+  atomic_store_explicit(&STAGES.head, head + 1, memory_order_release);
+}
+
+// Copy out the complete samples, oldest first.
+uint32_t stage_snapshot(struct stage_sample *out) {
+  uint64_t head = atomic_load_explicit(&STAGES.head, memory_order_acquire);
+  uint64_t first = head > STAGE_RING_SIZE ? head - STAGE_RING_SIZE : 0;
+  uint32_t n = 0;
+  for (uint64_t i = first; i < head; i++) {
+    struct stage_sample *s = &STAGES.s[i % STAGE_RING_SIZE];
+    if (atomic_load_explicit(&s->seq, memory_order_acquire) != i + 1)
+      continue;
+    out[n].start = s->start;
+    memcpy(out[n].ns, s->ns, sizeof(s->ns));
+    atomic_thread_fence(memory_order_acquire);
+    if (atomic_load_explicit(&s->seq, memory_order_relaxed) != i + 1)
+      continue;
+    atomic_store_explicit(&out[n].seq, i + 1, memory_order_relaxed);
+    n++;
+  }
+  return n;
+}
+
+void stage_json(const char *path, struct stage_sample *v, uint32_t n) {
+  FILE *f = fopen(path, "w");
+  if (!f) {
+    perror(path);
+    return;
+  }
+  fprintf(f, "{\"stages\": [");
+  for (uint32_t i = 0; i < STAGE_COUNT; i++)
+    fprintf(f, "%s\"%s\"", i ? ", " : "", stageNames[i]);
+  fprintf(f, "],\n \"samples\": [");
+  for (uint32_t i = 0; i < n; i++) {
+    fprintf(f, "%s\n  {\"frame\": %" PRIu64 ", \"start\": %" PRIu64
+               ", \"ns\": [",
+            i ? "," : "", atomic_load(&v[i].seq) - 1, v[i].start);
+    for (uint32_t j = 0; j < STAGE_COUNT; j++)
+      fprintf(f, "%s%" PRIu64, j ? ", " : "", v[i].ns[j]);
+    fprintf(f, "]}");
+  }
+  fprintf(f, "\n]}\n");
+  fclose(f);
+}
+
+// Safe from any thread but only one at a time.
+void stage_report() {
+  static struct stage_sample snap[STAGE_RING_SIZE];
+  static uint64_t v[STAGE_RING_SIZE];
+  uint32_t n = stage_snapshot(snap);
+  printf("stages over the last %u frames:\n", n);
+  for (uint32_t i = 0; n && i < STAGE_COUNT; i++) {
+    for (uint32_t j = 0; j < n; j++)
+      v[j] = snap[j].ns[i];
+    qsort(v, n, sizeof(v[0]), cmp_u64);
+    printf("  %-9s p50 %.3fms  p95 %.3fms  p99 %.3fms\n", stageNames[i],
+           percentile(v, n, 50) / 1e6, percentile(v, n, 95) / 1e6,
+           percentile(v, n, 99) / 1e6);
+  }
+  if (OPTS.stage_json)
+    stage_json(OPTS.stage_json, snap, n);
+}
+
+// Tracing
+//
+// Build with -DTRACE to record every frame's stages, the wayland callbacks
+// and the GPU's work on one CLOCK_MONOTONIC timeline. It is written as Chrome
+// trace event JSON at exit, open it in ui.perfetto.dev or chrome://tracing.
+// Without TRACE the TRACE_* macros are empty and none of this is built.
+
+#ifdef TRACE
+enum trace_track {
+  TRACK_WAYLAND = 1,
+  TRACK_RENDER,
+  TRACK_GPU,
+  TRACK_DISPLAY, // Presentation feedback, instants at scanout.
+};
+
+static const char *trackNames[] = {
+    NULL, "wayland", "render", "gpu", "display",
+};
+
+struct trace_event {
+  const char *name; // Must outlive the trace, string literals only.
+  uint64_t start;   // CLOCK_MONOTONIC ns.
+  uint64_t dur;     // 0 for an instant.
+  uint64_t frame;   // Frame id + 1, 0 if it belongs to none.
+  uint32_t track;
+};
+
+// Any thread claims a slot with one atomic add and owns it from then on. It
+// is only read after every writer has been joined. Full is full, later
+// events are dropped.
+#define TRACE_EVENTS (1 << 18)
+struct trace {
+  struct trace_event ev[TRACE_EVENTS];
+  _Atomic uint32_t count;
+  const char *path;
+
+  // GPU ticks to CLOCK_MONOTONIC: tick gpuBase happened at cpuBase.
+  PFN_vkGetCalibratedTimestampsEXT vkGetCalibratedTimestampsEXT;
+  bool calibrated;
+  uint64_t gpuBase, cpuBase, lastCalibration;
+  uint64_t tsMask;
+  double period;
+};
+
+struct trace TRACER = {.path = "trace.json"};
+static _Thread_local uint32_t traceTrack = TRACK_WAYLAND;
+
+void trace_push(uint32_t track, const char *name, uint64_t start, uint64_t dur,
+                uint64_t frame) {
+  uint32_t i =
+      atomic_fetch_add_explicit(&TRACER.count, 1, memory_order_relaxed);
+  if (i >= TRACE_EVENTS)
+    return;
+  TRACER.ev[i] = (struct trace_event){name, start, dur, frame, track};
+}
+
+struct trace_scope {
+  const char *name;
+  uint64_t start;
+};
+
+void trace_scope_end(struct trace_scope *s) {
+  trace_push(traceTrack, s->name, s->start, now_ns() - s->start, 0);
+}
+
+// The stages are back to back from frame start, dispatch runs before it and
+// is traced on its own.
+void trace_frame(uint64_t id, uint64_t start, const uint64_t ns[STAGE_COUNT]) {
+  uint64_t t = start, end = start;
+  for (uint32_t i = STAGE_FENCE; i < STAGE_COUNT; i++)
+    end += ns[i];
+  trace_push(TRACK_RENDER, "frame", start, end - start, id + 1);
+  for (uint32_t i = STAGE_FENCE; i < STAGE_COUNT; i++) {
+    if (ns[i])
+      trace_push(TRACK_RENDER, stageNames[i], t, ns[i], id + 1);
+    t += ns[i];
+  }
+}
+
+// Sample both clocks together. Redone every second since the GPU clock
+// drifts against the CPU's.
+void trace_calibrate() {
+  if (!TRACER.vkGetCalibratedTimestampsEXT ||
+      now_ns() - TRACER.lastCalibration < 1000000000ull)
+    return;
+  VkCalibratedTimestampInfoEXT info[2] = {0};
+  info[0].sType = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT;
+  info[0].timeDomain = VK_TIME_DOMAIN_DEVICE_EXT;
+  info[1].sType = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT;
+  info[1].timeDomain = VK_TIME_DOMAIN_CLOCK_MONOTONIC_EXT;
+  uint64_t ts[2], deviation;
+  if (TRACER.vkGetCalibratedTimestampsEXT(VK.dev, 2, info, ts, &deviation) !=
+      VK_SUCCESS)
+    return;
+  TRACER.gpuBase = ts[0];
+  TRACER.cpuBase = ts[1];
+  TRACER.lastCalibration = now_ns();
+  TRACER.calibrated = true;
+}
+
+uint64_t trace_gpu_ns(uint64_t tick) {
+  // Ticks only count up to tsMask, the sign is in its top bit.
+  uint64_t d = (tick - TRACER.gpuBase) & TRACER.tsMask;
+  int64_t ticks = d > TRACER.tsMask / 2 ? -(int64_t)(TRACER.tsMask - d) - 1
+                                       : (int64_t)d;
+  return TRACER.cpuBase + (int64_t)(ticks * TRACER.period);
+}
+
+// A frame's pair of timestamp queries, read back once its fence was seen
+// signalled at `seen`.
+void trace_gpu(uint64_t id, const uint64_t ts[2], uint64_t seen) {
+  // Without calibrated timestamps the GPU finished no later than we saw the
+  // fence, so line its clock up with the earliest such bound.
+  if (!TRACER.vkGetCalibratedTimestampsEXT &&
+      (!TRACER.calibrated || trace_gpu_ns(ts[1]) > seen)) {
+    TRACER.gpuBase = ts[1];
+    TRACER.cpuBase = seen;
+    TRACER.calibrated = true;
+  }
+  if (!TRACER.calibrated)
+    return;
+  uint64_t start = trace_gpu_ns(ts[0]);
+  trace_push(TRACK_GPU, "gpu", start, trace_gpu_ns(ts[1]) - start, id + 1);
+}
+
+void trace_write() {
+  FILE *f = fopen(TRACER.path, "w");
+  if (!f) {
+    perror(TRACER.path);
+    return;
+  }
+  uint32_t n = atomic_load(&TRACER.count);
+  if (n > TRACE_EVENTS) {
+    fprintf(stderr, "trace: dropped %u events\n", n - TRACE_EVENTS);
+    n = TRACE_EVENTS;
+  }
+  fprintf(f, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [");
+  for (uint32_t i = 1; i < ARRAY_SIZEOF(trackNames); i++)
+    fprintf(f, "%s\n{\"ph\": \"M\", \"name\": \"thread_name\", \"pid\": 1, "
+               "\"tid\": %u, \"args\": {\"name\": \"%s\"}}",
+            i > 1 ? "," : "", i, trackNames[i]);
+  for (uint32_t i = 0; i < n; i++) {
+    struct trace_event *e = &TRACER.ev[i];
+    // Microseconds, keeping the ns.
+    fprintf(f, ",\n{\"name\": \"%s\", \"pid\": 1, \"tid\": %u, \"ts\": %.3f",
+            e->name, e->track, e->start / 1e3);
+    if (e->dur)
+      fprintf(f, ", \"ph\": \"X\", \"dur\": %.3f", e->dur / 1e3);
+    else
+      fprintf(f, ", \"ph\": \"i\", \"s\": \"t\"");
+    if (e->frame)
+      fprintf(f, ", \"args\": {\"frame\": %" PRIu64 "}", e->frame - 1);
+    fprintf(f, "}");
+  }
+  fprintf(f, "\n]}\n");
+  fclose(f);
+  printf("trace: %u events written to %s\n", n, TRACER.path);
+}
+
+// Time the rest of the enclosing block.
+#define TRACE_SCOPE(NAME)                                                      \
+  struct trace_scope traceScope __attribute__((cleanup(trace_scope_end))) = { \
+      NAME, now_ns()}
+#define TRACE_THREAD(TRACK) (traceTrack = (TRACK))
+#define TRACE_INSTANT(TRACK, NAME, T, ID)                                      \
+  trace_push(TRACK, NAME, T, 0, (ID) + 1)
+#define TRACE_FRAME(ID, START, NS) trace_frame(ID, START, NS)
+#define TRACE_CALIBRATE() trace_calibrate()
+#define TRACE_GPU(ID, TS, SEEN) trace_gpu(ID, TS, SEEN)
+#define TRACE_WRITE() trace_write()
+#else
+#define TRACE_SCOPE(NAME)
+#define TRACE_THREAD(TRACK)
+#define TRACE_INSTANT(TRACK, NAME, T, ID)
+#define TRACE_FRAME(ID, START, NS)
+#define TRACE_CALIBRATE()
+#define TRACE_GPU(ID, TS, SEEN)
+#define TRACE_WRITE()
+#endif
+
+// Once a second print how often we woke up and how much cpu it cost us.
+void loop_stats() {
+  static uint64_t lastTime, lastCpu, lastWakeups, lastFrames;
+  uint64_t frames = atomic_load(&RENDER.drawn);
+  struct rusage ru;
+  getrusage(RUSAGE_SELF, &ru);
+  uint64_t cpu = (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000000ull +
+                 (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) * 1000ull;
+  uint64_t now = now_ns();
+
+  if (lastTime) {
+    double secs = (now - lastTime) / 1e9;
+    printf("loop: %.1f wakeups/s, %.1f frames/s, %.1f%% cpu\n",
+           (WSI.wakeups - lastWakeups) / secs, (frames - lastFrames) / secs,
+           100.0 * (cpu - lastCpu) / (now - lastTime));
+  }
+  lastTime = now;
+  lastCpu = cpu;
+  lastWakeups = WSI.wakeups;
+  lastFrames = frames;
+}
+
+// Dispatch wayland events, sleeping up to timeout_ms (-1 for forever) until
+// the compositor or one of our timers wakes us. Returns -1 if the connection
+// is gone.
+int wsi_dispatch(int timeout_ms) {
+  int wlfd = wl_display_get_fd(WSI.display);
+
+  // Only the thread which prepared may read, anything queued before then must
+  // be dispatched first.
+  while (wl_display_prepare_read(WSI.display) != 0) {
+    if (wl_display_dispatch_pending(WSI.display) == -1)
+      return -1;
+  }
+
+  // Requests must be out before we sleep on replies. If the socket is full
+  // also wake when it drains so we can finish flushing.
+  bool wantWrite = false;
+  if (wl_display_flush(WSI.display) == -1) {
+    if (errno != EAGAIN) {
+      wl_display_cancel_read(WSI.display);
+      return -1;
+    }
+    wantWrite = true;
+  }
+  if (wantWrite != WSI.wantWrite) {
+    struct epoll_event ev = {0};
+    ev.events = EPOLLIN | (wantWrite ? EPOLLOUT : 0);
+    ev.data.fd = wlfd;
+    epoll_ctl(WSI.epfd, EPOLL_CTL_MOD, wlfd, &ev);
+    WSI.wantWrite = wantWrite;
+  }
+
+  struct epoll_event events[8];
+  int n;
+  do {
+    n = epoll_wait(WSI.epfd, events, ARRAY_SIZEOF(events), timeout_ms);
+  } while (n == -1 && errno == EINTR);
+  WSI.wakeups++;
+  TRACE_SCOPE("wl_dispatch");
+
+  bool readable = false;
+  for (int i = 0; i < n; i++) {
+    if (events[i].data.fd == wlfd) {
+      readable |= (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) != 0;
+    } else if (events[i].data.fd == WSI.statsfd) {
+      timer_drain(WSI.statsfd);
+      loop_stats();
+    } else if (events[i].data.fd == WSI.sigfd) {
+      struct signalfd_siginfo si;
+      if (read(WSI.sigfd, &si, sizeof(si)) != sizeof(si))
+        continue;
+      if (si.ssi_signo == SIGUSR1)
+        stage_report();
+      else
+        WSI.window_closed = true;
+    } else if (events[i].data.fd == WSI.inputfd) {
+      if (timer_drain(WSI.inputfd))
+        input_arrived();
+    }
+  }
+
+  if (readable) {
+    if (wl_display_read_events(WSI.display) == -1)
+      return -1;
+  } else {
+    wl_display_cancel_read(WSI.display);
+  }
+  return wl_display_dispatch_pending(WSI.display);
 }
 
 // xdg_wm_base generic callbacks
@@ -145,9 +1474,70 @@ const struct xdg_wm_base_listener xdg_wm_base_listener = {
     .ping = xdg_wm_base_ping,
 };
 
+// What vulkan draws to within the window, in surface coordinates.
+void content_rect(int32_t *x, int32_t *y, int32_t *w, int32_t *h) {
+  *x = *y = 0;
+  *w = WSI.w;
+  *h = WSI.h;
+  if (!WSI.subsurface)
+    return;
+  *w = MAX((int32_t)(WSI.w * CONTENT_SHARE + 0.5), 1);
+  *h = MAX((int32_t)(WSI.h * CONTENT_SHARE + 0.5), 1);
+  *x = (WSI.w - *w) / 2;
+  *y = (WSI.h - *h) / 2;
+}
+
+// Tell the render thread everything that goes into the swapchain's size,
+// and with ack the configure it should ack.
+void wsi_send_size(bool ack, uint32_t serial) {
+  int32_t x, y, w, h;
+  content_rect(&x, &y, &w, &h);
+  render_send((struct render_event){.type = EV_RESIZE,
+                                    .w = w,
+                                    .h = h,
+                                    .scale = WSI.scale,
+                                    .resizing = WSI.resizing,
+                                    .ack = ack,
+                                    .serial = serial});
+}
+
+// Fill the window with the clear colour and centre the vulkan subsurface on
+// it. Commits the toplevel, and with it any configure we acked.
+void background_commit() {
+  int32_t x, y, w, h;
+  content_rect(&x, &y, &w, &h);
+  wl_subsurface_set_position(WSI.subsurface, x, y);
+  wp_viewport_set_destination(WSI.windowViewport, WSI.w, WSI.h);
+  wl_surface_attach(WSI.window, WSI.background[WSI.pressed], 0, 0);
+  wl_surface_damage_buffer(WSI.window, 0, 0, 1, 1);
+  wl_surface_commit(WSI.window);
+}
+
+// Single pixel buffers hold what goes to the display, encoded the way every
+// swapchain format gets our clear colour so the background matches it.
+uint32_t srgb_u32(float linear) {
+  return (uint32_t)(srgb_encode(linear) * (double)UINT32_MAX);
+}
+
+// Ends a configure sequence, however many toplevel configures it had the
+// render thread only hears the outcome.
 static void xdg_surface_configure(void *data, struct xdg_surface *xdg_surface,
                                   uint32_t serial) {
-  xdg_surface_ack_configure(xdg_surface, serial);
+  // Vulkan never commits the toplevel when it is only the background, which
+  // takes the new size right away.
+  if (WSI.subsurface) {
+    xdg_surface_ack_configure(xdg_surface, serial);
+    background_commit();
+    if (WSI.resized) {
+      WSI.resized = false;
+      wsi_send_size(false, 0);
+    }
+    return;
+  }
+  // Otherwise the ack waits for the render thread to commit at the new size,
+  // until then its commits would still answer the old configure.
+  WSI.resized = false;
+  wsi_send_size(true, serial);
 }
 
 const struct xdg_surface_listener xdg_surface_listener = {
@@ -159,6 +1549,17 @@ const struct xdg_surface_listener xdg_surface_listener = {
 static void xdg_toplevel_configure(void *data,
                                    struct xdg_toplevel *xdg_toplevel, int32_t w,
                                    int32_t h, struct wl_array *states) {
+  TRACE_SCOPE("xdg_toplevel_configure");
+
+  bool resizing = false;
+  uint32_t *state;
+  wl_array_for_each(state, states) {
+    resizing |= *state == XDG_TOPLEVEL_STATE_RESIZING;
+  }
+  if (WSI.resizing != resizing) {
+    WSI.resizing = resizing;
+    WSI.resized = true;
+  }
 
   // our chosen w/h are already fine.
   if (w == 0 && h == 0)
@@ -166,13 +1567,12 @@ static void xdg_toplevel_configure(void *data,
 
   printf("Toplevel configured\n");
 
-  // window resized
+  // window resized, the render thread acks with its first commit at the new
+  // size unless the background already did.
   if (WSI.w != w || WSI.h != h) {
     WSI.w = w;
     WSI.h = h;
-
-    WSI.vk.recreate = true;
-    wl_surface_commit(WSI.surface);
+    WSI.resized = true;
   }
 }
 
@@ -185,11 +1585,258 @@ struct xdg_toplevel_listener xdg_toplevel_listener = {
     .close = xdg_toplevel_close,
 };
 
-// wl_registry handling
+// wp_presentation callbacks
 
-static void global_registry_handler(void *data, struct wl_registry *registry,
-                                    uint32_t id, const char *interface,
-                                    uint32_t version) {
+uint64_t clock_ns(clockid_t clk) {
+  struct timespec ts;
+  clock_gettime(clk, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// Shift a timestamp taken on one clock onto another.
+uint64_t clock_convert(uint64_t t, clockid_t from, clockid_t to) {
+  if (from == to)
+    return t;
+  return t - clock_ns(from) + clock_ns(to);
+}
+
+static void wp_presentation_clock_id(void *data,
+                                     struct wp_presentation *presentation,
+                                     uint32_t clk_id) {
+  WSI.presentClock = clk_id;
+}
+
+const struct wp_presentation_listener presentation_listener = {
+    .clock_id = wp_presentation_clock_id,
+};
+
+static void feedback_sync_output(void *data,
+                                 struct wp_presentation_feedback *feedback,
+                                 struct wl_output *output) {}
+
+static void feedback_presented(void *data,
+                               struct wp_presentation_feedback *feedback,
+                               uint32_t tv_sec_hi, uint32_t tv_sec_lo,
+                               uint32_t tv_nsec, uint32_t refresh,
+                               uint32_t seq_hi, uint32_t seq_lo,
+                               uint32_t flags) {
+  uint64_t t = (((uint64_t)tv_sec_hi << 32) | tv_sec_lo) * 1000000000ull +
+               tv_nsec;
+  t = clock_convert(t, WSI.presentClock, CLOCK_MONOTONIC);
+  TRACE_INSTANT(TRACK_DISPLAY, "presented", t, (uintptr_t)data);
+  render_send((struct render_event){
+      .type = EV_PRESENTED,
+      .id = (uintptr_t)data,
+      .time = t,
+      .refresh = refresh,
+  });
+  wp_presentation_feedback_destroy(feedback);
+}
+
+static void feedback_discarded(void *data,
+                               struct wp_presentation_feedback *feedback) {
+  TRACE_INSTANT(TRACK_DISPLAY, "discarded", now_ns(), (uintptr_t)data);
+  render_send((struct render_event){.type = EV_PRESENTED,
+                                    .id = (uintptr_t)data});
+  wp_presentation_feedback_destroy(feedback);
+}
+
+const struct wp_presentation_feedback_listener feedback_listener = {
+    .sync_output = feedback_sync_output,
+    .presented = feedback_presented,
+    .discarded = feedback_discarded,
+};
+
+// zwp_linux_dmabuf_feedback_v1 callbacks
+
+static void dmabuf_format_table(void *data,
+                                struct zwp_linux_dmabuf_feedback_v1 *fb,
+                                int32_t fd, uint32_t size) {
+  if (FEEDBACK.table)
+    munmap((void *)FEEDBACK.table,
+           FEEDBACK.tableSize * sizeof(*FEEDBACK.table));
+  FEEDBACK.table = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  FEEDBACK.tableSize = size / sizeof(*FEEDBACK.table);
+  if (FEEDBACK.table == MAP_FAILED) {
+    FEEDBACK.table = NULL;
+    FEEDBACK.tableSize = 0;
+  }
+  close(fd);
+}
+
+static void dmabuf_main_device(void *data,
+                               struct zwp_linux_dmabuf_feedback_v1 *fb,
+                               struct wl_array *device) {
+  if (device->size == sizeof(dev_t))
+    memcpy(&FEEDBACK.mainDevice, device->data, sizeof(dev_t));
+}
+
+static void
+dmabuf_tranche_target_device(void *data,
+                             struct zwp_linux_dmabuf_feedback_v1 *fb,
+                             struct wl_array *device) {
+  if (device->size == sizeof(dev_t))
+    memcpy(&FEEDBACK.trancheDevice, device->data, sizeof(dev_t));
+}
+
+// Append e to *list, which starts out NULL.
+void dmabuf_formats_push(struct dmabuf_formats **list,
+                         struct format_table_entry e) {
+  uint32_t count = *list ? (*list)->count : 0;
+  *list = realloc(*list, sizeof(**list) + (count + 1) * sizeof(e));
+  assert(*list);
+  (*list)->entry[count] = e;
+  (*list)->count = count + 1;
+}
+
+// Only the formats matter to the WSI, it picks modifiers from its own
+// feedback. --dmabuf picks them itself so keeps the entries too.
+static void dmabuf_tranche_formats(void *data,
+                                   struct zwp_linux_dmabuf_feedback_v1 *fb,
+                                   struct wl_array *indices) {
+  uint16_t *index;
+  wl_array_for_each(index, indices) {
+    if (*index >= FEEDBACK.tableSize)
+      continue;
+    bool ours = false;
+    for (uint32_t i = 0; i < ARRAY_SIZEOF(surfaceFormats); i++) {
+      if (FEEDBACK.table[*index].format == surfaceFormats[i].drm) {
+        FEEDBACK.trancheFormats |= 1u << i;
+        ours = true;
+      }
+    }
+    if (ours && OPTS.backend == BACKEND_DMABUF)
+      dmabuf_formats_push(&FEEDBACK.trancheEntries, FEEDBACK.table[*index]);
+  }
+}
+
+static void dmabuf_tranche_flags(void *data,
+                                 struct zwp_linux_dmabuf_feedback_v1 *fb,
+                                 uint32_t flags) {
+  FEEDBACK.trancheScanout =
+      flags & ZWP_LINUX_DMABUF_FEEDBACK_V1_TRANCHE_FLAGS_SCANOUT;
+}
+
+// Scan out from another GPU would need a copy there anyway, only count what
+// the GPU we render with can hand over.
+static void dmabuf_tranche_done(void *data,
+                                struct zwp_linux_dmabuf_feedback_v1 *fb) {
+  struct dmabuf_formats *entries = FEEDBACK.trancheEntries;
+  if (FEEDBACK.trancheDevice == FEEDBACK.mainDevice) {
+    if (FEEDBACK.trancheScanout)
+      FEEDBACK.scanout |= FEEDBACK.trancheFormats;
+    for (uint32_t i = 0; entries && i < entries->count; i++)
+      dmabuf_formats_push(&FEEDBACK.entries, entries->entry[i]);
+  }
+  free(entries);
+  FEEDBACK.trancheEntries = NULL;
+  FEEDBACK.trancheDevice = 0;
+  FEEDBACK.trancheFormats = 0;
+  FEEDBACK.trancheScanout = false;
+}
+
+// Sent again whenever it changes, e.g. going fullscreen adds a scan out
+// tranche. Tell the render thread when that changes what it should pick, with
+// --dmabuf every time as the modifiers may have changed too.
+static void dmabuf_done(void *data, struct zwp_linux_dmabuf_feedback_v1 *fb) {
+  if (FEEDBACK.scanout != FEEDBACK.sent || OPTS.backend == BACKEND_DMABUF) {
+    FEEDBACK.sent = FEEDBACK.scanout;
+    render_send((struct render_event){.type = EV_FEEDBACK,
+                                      .scanout = FEEDBACK.sent,
+                                      .formats = FEEDBACK.entries});
+    FEEDBACK.entries = NULL;
+  }
+  FEEDBACK.scanout = 0;
+}
+
+const struct zwp_linux_dmabuf_feedback_v1_listener dmabuf_feedback_listener = {
+    .done = dmabuf_done,
+    .format_table = dmabuf_format_table,
+    .main_device = dmabuf_main_device,
+    .tranche_done = dmabuf_tranche_done,
+    .tranche_target_device = dmabuf_tranche_target_device,
+    .tranche_formats = dmabuf_tranche_formats,
+    .tranche_flags = dmabuf_tranche_flags,
+};
+
+// wp_fractional_scale_v1 callbacks
+
+static void fractional_preferred_scale(void *data,
+                                       struct wp_fractional_scale_v1 *fs,
+                                       uint32_t scale) {
+  if (scale == WSI.scale)
+    return;
+  WSI.scale = scale;
+  wsi_send_size(false, 0);
+}
+
+const struct wp_fractional_scale_v1_listener fractional_listener = {
+    .preferred_scale = fractional_preferred_scale,
+};
+
+// Input callbacks
+
+static void pointer_enter(void *data, struct wl_pointer *pointer,
+                          uint32_t serial, struct wl_surface *surface,
+                          wl_fixed_t x, wl_fixed_t y) {}
+
+static void pointer_leave(void *data, struct wl_pointer *pointer,
+                          uint32_t serial, struct wl_surface *surface) {}
+
+static void pointer_motion(void *data, struct wl_pointer *pointer,
+                           uint32_t time, wl_fixed_t x, wl_fixed_t y) {
+  input_arrived();
+}
+
+// Held buttons tint the window so every click has something to show.
+static void pointer_button(void *data, struct wl_pointer *pointer,
+                           uint32_t serial, uint32_t time, uint32_t button,
+                           uint32_t state) {
+  bool pressed = state == WL_POINTER_BUTTON_STATE_PRESSED;
+  atomic_store(&RENDER.pressed, pressed);
+  if (WSI.subsurface && WSI.pressed != pressed) {
+    WSI.pressed = pressed;
+    background_commit();
+  }
+  input_arrived();
+}
+
+static void pointer_axis(void *data, struct wl_pointer *pointer, uint32_t time,
+                         uint32_t axis, wl_fixed_t value) {
+  input_arrived();
+}
+
+const struct wl_pointer_listener pointer_listener = {
+    .enter = pointer_enter,
+    .leave = pointer_leave,
+    .motion = pointer_motion,
+    .button = pointer_button,
+    .axis = pointer_axis,
+};
+
+static void seat_capabilities(void *data, struct wl_seat *seat,
+                              uint32_t caps) {
+  if ((caps & WL_SEAT_CAPABILITY_POINTER) && !WSI.pointer) {
+    WSI.pointer = wl_seat_get_pointer(seat);
+    wl_pointer_add_listener(WSI.pointer, &pointer_listener, NULL);
+  } else if (!(caps & WL_SEAT_CAPABILITY_POINTER) && WSI.pointer) {
+    wl_pointer_destroy(WSI.pointer);
+    WSI.pointer = NULL;
+  }
+}
+
+static void seat_name(void *data, struct wl_seat *seat, const char *name) {}
+
+const struct wl_seat_listener seat_listener = {
+    .capabilities = seat_capabilities,
+    .name = seat_name,
+};
+
+// wl_registry handling
+
+static void global_registry_handler(void *data, struct wl_registry *registry,
+                                    uint32_t id, const char *interface,
+                                    uint32_t version) {
   if (strcmp(interface, wl_compositor_interface.name) == 0) {
     WSI.compositor =
         wl_registry_bind(registry, id, &wl_compositor_interface, 4);
@@ -201,113 +1848,1982 @@ static void global_registry_handler(void *data, struct wl_registry *registry,
     WSI.wm = wl_registry_bind(registry, id, &xdg_wm_base_interface, 2);
     xdg_wm_base_add_listener(WSI.wm, &xdg_wm_base_listener, NULL);
   }
+  if (strcmp(interface, wp_presentation_interface.name) == 0) {
+    WSI.presentation =
+        wl_registry_bind(registry, id, &wp_presentation_interface, 1);
+    WSI.presentClock = CLOCK_MONOTONIC; // Until clock_id says otherwise.
+    wp_presentation_add_listener(WSI.presentation, &presentation_listener,
+                                 NULL);
+  }
+  if (strcmp(interface, wp_tearing_control_manager_v1_interface.name) == 0) {
+    WSI.tearingManager = wl_registry_bind(
+        registry, id, &wp_tearing_control_manager_v1_interface, 1);
+  }
+  if (strcmp(interface, wp_fifo_manager_v1_interface.name) == 0) {
+    WSI.fifoManager =
+        wl_registry_bind(registry, id, &wp_fifo_manager_v1_interface, 1);
+  }
+  if (strcmp(interface, wp_commit_timing_manager_v1_interface.name) == 0) {
+    WSI.commitTiming = wl_registry_bind(
+        registry, id, &wp_commit_timing_manager_v1_interface, 1);
+  }
+  if (strcmp(interface, wp_viewporter_interface.name) == 0) {
+    WSI.viewporter =
+        wl_registry_bind(registry, id, &wp_viewporter_interface, 1);
+  }
+  if (strcmp(interface, wp_fractional_scale_manager_v1_interface.name) == 0) {
+    WSI.fractionalManager = wl_registry_bind(
+        registry, id, &wp_fractional_scale_manager_v1_interface, 1);
+  }
+  // Feedback is version 4, earlier versions only list formats.
+  if (strcmp(interface, zwp_linux_dmabuf_v1_interface.name) == 0 &&
+      version >= 4) {
+    WSI.dmabuf =
+        wl_registry_bind(registry, id, &zwp_linux_dmabuf_v1_interface, 4);
+  }
+  if (strcmp(interface, wl_subcompositor_interface.name) == 0) {
+    WSI.subcompositor =
+        wl_registry_bind(registry, id, &wl_subcompositor_interface, 1);
+  }
+  if (strcmp(interface, wp_single_pixel_buffer_manager_v1_interface.name) ==
+      0) {
+    WSI.singlePixel = wl_registry_bind(
+        registry, id, &wp_single_pixel_buffer_manager_v1_interface, 1);
+  }
+  if (strcmp(interface, wl_shm_interface.name) == 0) {
+    WSI.shm = wl_registry_bind(registry, id, &wl_shm_interface, 1);
+  }
+  // Version 1 is all the pointer events we need.
+  if (strcmp(interface, wl_seat_interface.name) == 0 && !WSI.seat) {
+    WSI.seat = wl_registry_bind(registry, id, &wl_seat_interface, 1);
+    wl_seat_add_listener(WSI.seat, &seat_listener, NULL);
+  }
+}
+
+static void global_registry_remover(void *data, struct wl_registry *registry,
+                                    uint32_t id) {
+  // This section deliberately left blank.
+}
+
+const struct wl_registry_listener registry_listener = {
+    .global = global_registry_handler,
+    .global_remove = global_registry_remover,
+};
+
+// The render thread requests one of these with every commit it makes.
+static void wl_surface_frame_done(void *data, struct wl_callback *cb,
+                                  uint32_t time) {
+  TRACE_SCOPE("wl_surface_frame_done");
+  // Mark callback handled.
+  wl_callback_destroy(cb);
+  render_send((struct render_event){.type = EV_FRAME});
+}
+
+static const struct wl_callback_listener wl_surface_frame_callback_listener = {
+    .done = wl_surface_frame_done,
+};
+
+// The compositor is done with one of our --dmabuf buffers, the render thread
+// may draw into it again.
+static void buffer_release(void *data, struct wl_buffer *buffer) {
+  render_send((struct render_event){.type = EV_RELEASE,
+                                    .id = (uintptr_t)data});
+}
+
+static const struct wl_buffer_listener buffer_listener = {
+    .release = buffer_release,
+};
+
+// Both --dmabuf and --cpu keep count buffers tagged generation << 8 | index,
+// busy from their commit until released.
+
+// A buffer the compositor isn't holding, or -1.
+int32_t pool_acquire(const bool *busy, uint32_t count) {
+  for (uint32_t i = 0; i < count; i++) {
+    if (!busy[i])
+      return i;
+  }
+  return -1;
+}
+
+// The compositor let go of buffer id.
+void pool_release(bool *busy, uint32_t count, uint32_t generation,
+                  uint64_t *exhausted, uint64_t id) {
+  // A pool we've since replaced.
+  if (id >> 8 != generation)
+    return;
+  // We had to wait for it.
+  if (pool_acquire(busy, count) == -1)
+    (*exhausted)++;
+  busy[id & 0xff] = false;
+}
+
+const char *present_mode_name(VkPresentModeKHR mode) {
+  for (uint32_t i = 0; i < ARRAY_SIZEOF(presentModeNames); i++) {
+    if (presentModeNames[i].mode == mode)
+      return presentModeNames[i].name;
+  }
+  return "unknown";
+}
+
+// The fewest images that never hold a frame up. minImageCount is what the
+// driver needs to present, each frame in flight past the first adds one that
+// may be waiting on the GPU or the vblank. Every image is memory and a frame
+// of latency when the queue fills, so no more than that.
+uint32_t swapImageCount() {
+  VkSurfaceCapabilitiesKHR *caps = &WSI.vk.surfCaps;
+  uint32_t count = caps->minImageCount + RENDER.frameCount - 1;
+  // Mailbox also needs a spare to draw into while one waits to replace the
+  // one on screen.
+  if (WSI.vk.presentMode == VK_PRESENT_MODE_MAILBOX_KHR)
+    count++;
+  if (caps->maxImageCount && count > caps->maxImageCount)
+    count = caps->maxImageCount;
+  return count;
+}
+
+VkImageView image_view_new(VkImage image, VkFormat format) {
+  VkImageViewCreateInfo createViewInfo = {0};
+  createViewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+  createViewInfo.image = image;
+  createViewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+  createViewInfo.format = format;
+  createViewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  createViewInfo.subresourceRange.baseMipLevel = 0;
+  createViewInfo.subresourceRange.levelCount = 1;
+  createViewInfo.subresourceRange.baseArrayLayer = 0;
+  createViewInfo.subresourceRange.layerCount = 1;
+  VkImageView view;
+  VkResult result = vkCreateImageView(VK.dev, &createViewInfo, NULL, &view);
+  assert(result == VK_SUCCESS);
+  return view;
+}
+
+// Destroy r once frame r.frame is being recorded and all before it are done.
+void retire(struct retired r, uint64_t frame) {
+  struct retire_queue *q = &RENDER.retired;
+  assert(q->head - q->tail < RETIRE_QUEUE_SIZE);
+  r.frame = frame;
+  q->r[q->head++ % RETIRE_QUEUE_SIZE] = r;
+}
+
+// Every frame before `done` has finished on the GPU.
+void retire_collect(uint64_t done) {
+  struct retire_queue *q = &RENDER.retired;
+  while (q->tail != q->head) {
+    struct retired *r = &q->r[q->tail % RETIRE_QUEUE_SIZE];
+    if (r->frame > done || r->present > RENDER.presentsDone)
+      break;
+    q->tail++;
+    switch (r->type) {
+    case RETIRED_FRAMEBUFFER:
+      vkDestroyFramebuffer(VK.dev, r->fb, NULL);
+      break;
+    case RETIRED_IMAGE_VIEW:
+      vkDestroyImageView(VK.dev, r->view, NULL);
+      break;
+    case RETIRED_IMAGE:
+      vkDestroyImage(VK.dev, r->image, NULL);
+      break;
+    case RETIRED_MEMORY:
+      vk_free(r->mem);
+      break;
+    case RETIRED_ALLOCATION:
+      vk_memory_free(r->alloc);
+      break;
+    case RETIRED_SEMAPHORE:
+      vkDestroySemaphore(VK.dev, r->semaphore, NULL);
+      break;
+    case RETIRED_SWAPCHAIN:
+      vkDestroySwapchainKHR(VK.dev, r->swapchain, NULL);
+      break;
+    case RETIRED_PIPELINE:
+      vkDestroyPipeline(VK.dev, r->pipeline, NULL);
+      break;
+    case RETIRED_RENDER_PASS:
+      vkDestroyRenderPass(VK.dev, r->renderPass, NULL);
+      break;
+    }
+  }
+}
+
+// The requested depth, else 8 bit, else whatever comes first, scan out
+// capable first within those.
+int32_t format_score(uint32_t j) {
+  int32_t score = ARRAY_SIZEOF(surfaceFormats) - j;
+  if (surfaceFormats[j].depth == OPTS.surface_depth)
+    score += 200;
+  else if (surfaceFormats[j].depth == DEPTH_8)
+    score += 100;
+  // Within a depth, one the compositor can put straight on a plane.
+  if (WSI.vk.scanout & (1u << j))
+    score += 50;
+  return score;
+}
+
+// Say what we draw to now and whether it is what was asked for.
+void format_report(int32_t picked) {
+  if (picked == -1)
+    printf("surface format %d\n", WSI.vk.swapFormat);
+  else
+    printf("surface format %s\n", surfaceFormats[picked].name);
+  if (picked == -1 || surfaceFormats[picked].depth != OPTS.surface_depth)
+    fprintf(stderr, "no %s surface format\n",
+            surfaceDepthNames[OPTS.surface_depth]);
+}
+
+// Whether we have to encode what we draw: the format takes it as is, yet it
+// is shown as sRGB. scRGB is linear like us.
+bool format_encodes() {
+  if (WSI.vk.swapSpace != VK_COLOR_SPACE_SRGB_NONLINEAR_KHR)
+    return false;
+  switch (WSI.vk.swapFormat) {
+  case VK_FORMAT_B8G8R8A8_SRGB:
+  case VK_FORMAT_R8G8B8A8_SRGB:
+  case VK_FORMAT_A8B8G8R8_SRGB_PACK32:
+    return false;
+  default:
+    return true;
+  }
+}
+
+// Score what the surface offers. Returns the surfaceFormats entry or -1.
+int32_t surface_format_pick() {
+  uint32_t count = 128;
+  VkSurfaceFormatKHR formats[128];
+  vkGetPhysicalDeviceSurfaceFormatsKHR(VK.pdev, WSI.vk.surface, &count,
+                                       formats);
+  assert(count > 0);
+
+  int32_t best = -1, bestScore = 0;
+  for (uint32_t i = 0; i < count; i++) {
+    for (uint32_t j = 0; j < ARRAY_SIZEOF(surfaceFormats); j++) {
+      if (formats[i].format != surfaceFormats[j].format ||
+          formats[i].colorSpace != surfaceFormats[j].space)
+        continue;
+      int32_t score = format_score(j);
+      if (score > bestScore) {
+        best = j;
+        bestScore = score;
+      }
+    }
+  }
+  if (best == -1) {
+    WSI.vk.swapFormat = formats[0].format;
+    WSI.vk.swapSpace = formats[0].colorSpace;
+  } else {
+    WSI.vk.swapFormat = surfaceFormats[best].format;
+    WSI.vk.swapSpace = surfaceFormats[best].space;
+  }
+  return best;
+}
+
+// The upscale is a linear filtered blit straight into the swapchain image.
+bool dynres_supported() {
+  VkFormatProperties props;
+  vkGetPhysicalDeviceFormatProperties(VK.pdev, WSI.vk.swapFormat, &props);
+  VkFormatFeatureFlags need = VK_FORMAT_FEATURE_BLIT_SRC_BIT |
+                              VK_FORMAT_FEATURE_BLIT_DST_BIT |
+                              VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+  return (props.optimalTilingFeatures & need) == need &&
+         (WSI.vk.surfCaps.supportedUsageFlags &
+          VK_IMAGE_USAGE_TRANSFER_DST_BIT);
+}
+
+// Swap in a new swapchain, usually without waiting for anything. The old one
+// keeps showing what was already presented until the new one's first present
+// and it, with everything made for its images, is retired behind `frame`.
+// Its presents may still wait on the semaphores, those and the swapchain also
+// wait for one of the new swapchain's presents to come back.
+VkResult recreate_swapchain(uint64_t frame) {
+  TRACE_SCOPE("recreate_swapchain");
+  // Resizing every frame no image is ever reused, so nothing comes back. Wait
+  // for the queue, presents included, rather than let the retired pile up.
+  struct retire_queue *q = &RENDER.retired;
+  if (q->head - q->tail > RETIRE_QUEUE_SIZE / 2) {
+    vkQueueWaitIdle(VK.gfx);
+    RENDER.presentsDone = RENDER.presents;
+    retire_collect(frame);
+  }
+  uint64_t present = RENDER.presents + 1;
+  for (uint32_t i = 0; i < WSI.vk.imgCount; i++) {
+    struct swap_image *img = &WSI.vk.img[i];
+    if (img->fb)
+      retire((struct retired){RETIRED_FRAMEBUFFER, .fb = img->fb}, frame);
+    retire((struct retired){RETIRED_IMAGE_VIEW, .view = img->view}, frame);
+    retire((struct retired){RETIRED_SEMAPHORE,
+                            .semaphore = img->renderFinished,
+                            .present = present},
+           frame);
+  }
+  VkSwapchainKHR oldSwapchain = WSI.vk.swapchain;
+
+  // Can change with the output we are on, the caller rebuilds what depends on
+  // it.
+  VkFormat oldFormat = WSI.vk.swapFormat;
+  int32_t picked = surface_format_pick();
+  if (WSI.vk.swapFormat != oldFormat)
+    format_report(picked);
+  bool dynres = OPTS.dynamic_res && dynres_supported();
+  if (OPTS.dynamic_res && !dynres && (DYNRES.enabled || !oldSwapchain))
+    fprintf(stderr, "can't blit to the swapchain, no dynamic resolution\n");
+  DYNRES.enabled = dynres;
+
+  VkSwapchainCreateInfoKHR createSwapInfo = {0};
+  createSwapInfo.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
+  createSwapInfo.surface = WSI.vk.surface;
+  createSwapInfo.minImageCount = swapImageCount();
+  createSwapInfo.imageFormat = WSI.vk.swapFormat;
+  createSwapInfo.imageColorSpace = WSI.vk.swapSpace;
+  createSwapInfo.imageExtent = swapSize();
+  createSwapInfo.imageArrayLayers = 1;
+  createSwapInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+  if (DYNRES.enabled)
+    createSwapInfo.imageUsage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+  createSwapInfo.preTransform = WSI.vk.surfCaps.currentTransform;
+  createSwapInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
+  createSwapInfo.presentMode = WSI.vk.presentMode;
+  createSwapInfo.clipped = VK_TRUE;
+  // Only same queue gfx/present.
+  createSwapInfo.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  // Lets the driver hand over buffers, the old swapchain is retired either way
+  // and can no longer be acquired from.
+  createSwapInfo.oldSwapchain = oldSwapchain;
+
+  VkResult result =
+      vkCreateSwapchainKHR(VK.dev, &createSwapInfo, NULL, &WSI.vk.swapchain);
+  assert(result == VK_SUCCESS);
+  if (oldSwapchain)
+    retire((struct retired){RETIRED_SWAPCHAIN, .swapchain = oldSwapchain,
+                            .present = present},
+           frame);
+
+  // The driver may give us more than we asked for.
+  vkGetSwapchainImagesKHR(VK.dev, WSI.vk.swapchain, &WSI.vk.imgCount, NULL);
+  VkImage images[WSI.vk.imgCount];
+  vkGetSwapchainImagesKHR(VK.dev, WSI.vk.swapchain, &WSI.vk.imgCount, images);
+  free(WSI.vk.img);
+  WSI.vk.img = calloc(WSI.vk.imgCount, sizeof(*WSI.vk.img));
+  assert(WSI.vk.img);
+
+  VkSemaphoreCreateInfo semaphoreInfo = {0};
+  semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+  for (uint32_t i = 0; i < WSI.vk.imgCount; i++) {
+    struct swap_image *img = &WSI.vk.img[i];
+    img->img = images[i];
+    img->view = image_view_new(img->img, WSI.vk.swapFormat);
+    assert(vkCreateSemaphore(VK.dev, &semaphoreInfo, NULL,
+                             &img->renderFinished) == VK_SUCCESS);
+  }
+
+  return result;
+}
+
+// Swapchain sized, like everything we draw into.
+VkFramebuffer framebuffer_new(VkRenderPass renderPass, VkImageView view) {
+  VkImageView attachments[1] = {view};
+  VkFramebufferCreateInfo framebufferInfo = {0};
+  framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+  framebufferInfo.renderPass = renderPass;
+  framebufferInfo.attachmentCount = ARRAY_SIZEOF(attachments);
+  framebufferInfo.pAttachments = attachments;
+  framebufferInfo.width = swapSize().width;
+  framebufferInfo.height = swapSize().height;
+  framebufferInfo.layers = 1;
+
+  VkFramebuffer fb;
+  VkResult result = vkCreateFramebuffer(VK.dev, &framebufferInfo, NULL, &fb);
+  assert(result == VK_SUCCESS);
+  return fb;
+}
+
+void framebuffers_create(VkRenderPass renderPass) {
+  for (uint32_t i = 0; i < WSI.vk.imgCount; i++)
+    WSI.vk.img[i].fb = framebuffer_new(renderPass, WSI.vk.img[i].view);
+}
+
+// All of surface, clipped to it so it never needs updating.
+void opaque_region_set(struct wl_surface *surface) {
+  struct wl_region *opaque = wl_compositor_create_region(WSI.compositor);
+  wl_region_add(opaque, 0, 0, INT32_MAX, INT32_MAX);
+  wl_surface_set_opaque_region(surface, opaque);
+  wl_region_destroy(opaque);
+}
+
+// Query the surface and create the first swapchain.
+void swapchain_init() {
+  vkGetPhysicalDeviceSurfaceCapabilitiesKHR(VK.pdev, WSI.vk.surface,
+                                            &WSI.vk.surfCaps);
+  uint32_t presentModeCount = 8;
+  VkPresentModeKHR presentModes[8] = {0};
+  vkGetPhysicalDeviceSurfacePresentModesKHR(VK.pdev, WSI.vk.surface,
+                                            &presentModeCount, presentModes);
+  assert(presentModeCount > 0);
+
+  // FIFO is the only mode every driver must have.
+  WSI.vk.presentMode = VK_PRESENT_MODE_FIFO_KHR;
+  for (uint32_t i = 0; i < presentModeCount; i++) {
+    if (presentModes[i] == OPTS.present_mode)
+      WSI.vk.presentMode = OPTS.present_mode;
+  }
+  if (WSI.vk.presentMode != OPTS.present_mode)
+    fprintf(stderr, "present mode %s unsupported, using fifo\n",
+            present_mode_name(OPTS.present_mode));
+  // Without vsync there is nothing to pace or wait for, unless the compositor
+  // is doing the vsync for us.
+  RENDER.uncapped = (WSI.vk.presentMode == VK_PRESENT_MODE_MAILBOX_KHR ||
+                     WSI.vk.presentMode == VK_PRESENT_MODE_IMMEDIATE_KHR) &&
+                    !WSI.fifo;
+
+  recreate_swapchain(0);
+
+  // Every swapchain is made opaque, so the compositor need not blend what is
+  // below us.
+  opaque_region_set(WSI.surface);
+}
+
+// A swapchain sized image of our own in device local memory.
+VkImage image_new(VkFormat format, VkImageUsageFlags usage,
+                  struct vk_alloc *alloc) {
+  VkImageCreateInfo imageInfo = {0};
+  imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+  imageInfo.imageType = VK_IMAGE_TYPE_2D;
+  imageInfo.format = format;
+  imageInfo.extent = (VkExtent3D){swapSize().width, swapSize().height, 1};
+  imageInfo.mipLevels = 1;
+  imageInfo.arrayLayers = 1;
+  imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+  imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+  imageInfo.usage = usage;
+  imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  VkImage image;
+  VkResult result = vkCreateImage(VK.dev, &imageInfo, NULL, &image);
+  assert(result == VK_SUCCESS);
+
+  *alloc = vk_memory_alloc(VK_NULL_HANDLE, image,
+                           VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+  vkBindImageMemory(VK.dev, image, alloc->mem, alloc->offset);
+  return image;
+}
+
+// What a surface would have told us, for when there is none to ask.
+// swapSize() clamps to the extents and frames go out on frame callbacks, as
+// the WSI does for fifo.
+void caps_fake(VkExtent2D max) {
+  WSI.vk.surfCaps.minImageExtent = (VkExtent2D){1, 1};
+  WSI.vk.surfCaps.maxImageExtent = max;
+  WSI.vk.presentMode = VK_PRESENT_MODE_FIFO_KHR;
+}
+
+// Headless stand in for the swapchain, one image per frame in flight so a
+// frame never has to wait for another's image.
+void offscreen_create() {
+  WSI.vk.swapFormat = VK_FORMAT_B8G8R8A8_SRGB;
+  caps_fake((VkExtent2D){WSI.vk.w, WSI.vk.h});
+  WSI.vk.imgCount = RENDER.frameCount;
+  WSI.vk.img = calloc(WSI.vk.imgCount, sizeof(*WSI.vk.img));
+  assert(WSI.vk.img);
+
+  for (uint32_t i = 0; i < WSI.vk.imgCount; i++) {
+    struct swap_image *img = &WSI.vk.img[i];
+    img->img = image_new(WSI.vk.swapFormat,
+                         VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+                             VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+                         &img->alloc);
+    img->view = image_view_new(img->img, WSI.vk.swapFormat);
+  }
+}
+
+// Dmabuf presentation
+
+// External memory and semaphores are vulkan 1.1, modifiers build on those.
+static const char *dmabufExtensions[] = {
+    "VK_KHR_external_memory_fd",        "VK_EXT_external_memory_dma_buf",
+    "VK_KHR_image_format_list",         "VK_EXT_image_drm_format_modifier",
+    "VK_EXT_queue_family_foreign",      "VK_KHR_external_semaphore_fd",
+};
+
+// Modifiers for surfaceFormats entry j which we can draw to and the compositor
+// imports, written to out if not NULL. Returns how many.
+uint32_t dmabuf_modifiers(uint32_t j, uint64_t *out) {
+  VkDrmFormatModifierPropertiesEXT props[DMABUF_MODIFIERS];
+  VkDrmFormatModifierPropertiesListEXT list = {0};
+  list.sType = VK_STRUCTURE_TYPE_DRM_FORMAT_MODIFIER_PROPERTIES_LIST_EXT;
+  list.drmFormatModifierCount = ARRAY_SIZEOF(props);
+  list.pDrmFormatModifierProperties = props;
+  VkFormatProperties2 formatProps = {0};
+  formatProps.sType = VK_STRUCTURE_TYPE_FORMAT_PROPERTIES_2;
+  formatProps.pNext = &list;
+  VK.vkGetPhysicalDeviceFormatProperties2(VK.pdev, surfaceFormats[j].format,
+                                          &formatProps);
+
+  const struct dmabuf_formats *theirs = WSI.vk.formats;
+  uint32_t count = 0;
+  for (uint32_t i = 0; i < list.drmFormatModifierCount; i++) {
+    // Compressed modifiers keep their metadata in planes of their own, one
+    // plane keeps the wl_buffer simple.
+    if (props[i].drmFormatModifierPlaneCount != 1 ||
+        !(props[i].drmFormatModifierTilingFeatures &
+          VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BIT))
+      continue;
+    for (uint32_t k = 0; theirs && k < theirs->count; k++) {
+      if (theirs->entry[k].format == surfaceFormats[j].drm &&
+          theirs->entry[k].modifier == props[i].drmFormatModifier) {
+        if (out)
+          out[count] = props[i].drmFormatModifier;
+        count++;
+        break;
+      }
+    }
+  }
+  return count;
+}
+
+// surface_format_pick for our own buffers, scoring what the compositor
+// imports and we can draw to with a modifier it takes. sRGB only, there is no
+// colour management to say otherwise. Returns the surfaceFormats entry, its
+// modifiers go to DMABUF, or -1.
+int32_t dmabuf_format_pick() {
+  int32_t best = -1, bestScore = 0;
+  for (uint32_t j = 0; j < ARRAY_SIZEOF(surfaceFormats); j++) {
+    if (surfaceFormats[j].space != VK_COLOR_SPACE_SRGB_NONLINEAR_KHR ||
+        !dmabuf_modifiers(j, NULL))
+      continue;
+    int32_t score = format_score(j);
+    if (score > bestScore) {
+      best = j;
+      bestScore = score;
+    }
+  }
+  if (best != -1) {
+    WSI.vk.swapFormat = surfaceFormats[best].format;
+    WSI.vk.swapSpace = surfaceFormats[best].space;
+    DMABUF.modifierCount = dmabuf_modifiers(best, DMABUF.modifiers);
+  }
+  DMABUF.format = best;
+  return best;
+}
+
+// Pool buffer i: an image in one of the modifiers we share, exported as a
+// dmabuf and wrapped in a wl_buffer whose release is tagged with the pool.
+void dmabuf_buffer_new(uint32_t i) {
+  struct swap_image *img = &WSI.vk.img[i];
+  VkExtent2D size = swapSize();
+  VkExternalMemoryImageCreateInfo external = {0};
+  external.sType = VK_STRUCTURE_TYPE_EXTERNAL_MEMORY_IMAGE_CREATE_INFO;
+  external.handleTypes = VK_EXTERNAL_MEMORY_HANDLE_TYPE_DMA_BUF_BIT_EXT;
+  VkImageDrmFormatModifierListCreateInfoEXT modifiers = {0};
+  modifiers.sType =
+      VK_STRUCTURE_TYPE_IMAGE_DRM_FORMAT_MODIFIER_LIST_CREATE_INFO_EXT;
+  modifiers.pNext = &external;
+  modifiers.drmFormatModifierCount = DMABUF.modifierCount;
+  modifiers.pDrmFormatModifiers = DMABUF.modifiers;
+  VkImageCreateInfo imageInfo = {0};
+  imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+  imageInfo.pNext = &modifiers;
+  imageInfo.imageType = VK_IMAGE_TYPE_2D;
+  imageInfo.format = WSI.vk.swapFormat;
+  imageInfo.extent = (VkExtent3D){size.width, size.height, 1};
+  imageInfo.mipLevels = 1;
+  imageInfo.arrayLayers = 1;
+  imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+  imageInfo.tiling = VK_IMAGE_TILING_DRM_FORMAT_MODIFIER_EXT;
+  imageInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+  imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  VkResult result = vkCreateImage(VK.dev, &imageInfo, NULL, &img->img);
+  assert(result == VK_SUCCESS);
+
+  // Exported memory is the image's alone.
+  VkMemoryRequirements reqs;
+  vkGetImageMemoryRequirements(VK.dev, img->img, &reqs);
+  VkMemoryDedicatedAllocateInfo dedicated = {0};
+  dedicated.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO;
+  dedicated.image = img->img;
+  VkExportMemoryAllocateInfo exportInfo = {0};
+  exportInfo.sType = VK_STRUCTURE_TYPE_EXPORT_MEMORY_ALLOCATE_INFO;
+  exportInfo.pNext = &dedicated;
+  exportInfo.handleTypes = VK_EXTERNAL_MEMORY_HANDLE_TYPE_DMA_BUF_BIT_EXT;
+  VkMemoryAllocateInfo allocInfo = {0};
+  allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+  allocInfo.pNext = &exportInfo;
+  allocInfo.allocationSize = reqs.size;
+  allocInfo.memoryTypeIndex = findMemoryIdx(
+      VK.pmem, reqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+  assert(allocInfo.memoryTypeIndex != -1);
+  img->mem = vk_allocate(&allocInfo);
+  vkBindImageMemory(VK.dev, img->img, img->mem, 0);
+  img->view = image_view_new(img->img, WSI.vk.swapFormat);
+
+  // Which modifier the driver went with and where it put the plane.
+  VkImageDrmFormatModifierPropertiesEXT modifier = {0};
+  modifier.sType = VK_STRUCTURE_TYPE_IMAGE_DRM_FORMAT_MODIFIER_PROPERTIES_EXT;
+  result = VK.vkGetImageDrmFormatModifierPropertiesEXT(VK.dev, img->img,
+                                                       &modifier);
+  assert(result == VK_SUCCESS);
+  DMABUF.modifier = modifier.drmFormatModifier;
+  VkImageSubresource plane = {VK_IMAGE_ASPECT_MEMORY_PLANE_0_BIT_EXT, 0, 0};
+  VkSubresourceLayout layout;
+  vkGetImageSubresourceLayout(VK.dev, img->img, &plane, &layout);
+  VkMemoryGetFdInfoKHR fdInfo = {0};
+  fdInfo.sType = VK_STRUCTURE_TYPE_MEMORY_GET_FD_INFO_KHR;
+  fdInfo.memory = img->mem;
+  fdInfo.handleType = VK_EXTERNAL_MEMORY_HANDLE_TYPE_DMA_BUF_BIT_EXT;
+  result = VK.vkGetMemoryFdKHR(VK.dev, &fdInfo, &img->fd);
+  assert(result == VK_SUCCESS);
+
+  struct zwp_linux_buffer_params_v1 *params =
+      zwp_linux_dmabuf_v1_create_params(WSI.dmabuf);
+  zwp_linux_buffer_params_v1_add(params, img->fd, 0, layout.offset,
+                                 layout.rowPitch, DMABUF.modifier >> 32,
+                                 DMABUF.modifier & 0xffffffff);
+  img->buffer = zwp_linux_buffer_params_v1_create_immed(
+      params, size.width, size.height, surfaceFormats[DMABUF.format].drm, 0);
+  zwp_linux_buffer_params_v1_destroy(params);
+  wl_buffer_add_listener(
+      img->buffer, &buffer_listener,
+      (void *)(uintptr_t)((uint64_t)DMABUF.generation << 8 | i));
+
+  // Exported to the dmabuf's fences after every submit.
+  VkExportSemaphoreCreateInfo exportSemaphore = {0};
+  exportSemaphore.sType = VK_STRUCTURE_TYPE_EXPORT_SEMAPHORE_CREATE_INFO;
+  exportSemaphore.handleTypes = VK_EXTERNAL_SEMAPHORE_HANDLE_TYPE_SYNC_FD_BIT;
+  VkSemaphoreCreateInfo semaphoreInfo = {0};
+  semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+  semaphoreInfo.pNext = &exportSemaphore;
+  result = vkCreateSemaphore(VK.dev, &semaphoreInfo, NULL,
+                             &img->renderFinished);
+  assert(result == VK_SUCCESS);
+}
+
+// recreate_swapchain for our own buffers: a new pool at swapSize() in what
+// the compositor takes now. The old images may still be drawn to by frames in
+// flight so are retired behind frame. Their wl_buffers can go at once, the
+// compositor keeps its own reference to whatever it still shows.
+void dmabuf_create(uint64_t frame) {
+  TRACE_SCOPE("dmabuf_create");
+  for (uint32_t i = 0; i < WSI.vk.imgCount; i++) {
+    struct swap_image *img = &WSI.vk.img[i];
+    if (img->fb)
+      retire((struct retired){RETIRED_FRAMEBUFFER, .fb = img->fb}, frame);
+    retire((struct retired){RETIRED_IMAGE_VIEW, .view = img->view}, frame);
+    retire((struct retired){RETIRED_IMAGE, .image = img->img}, frame);
+    retire((struct retired){RETIRED_MEMORY, .mem = img->mem}, frame);
+    retire((struct retired){RETIRED_SEMAPHORE,
+                            .semaphore = img->renderFinished},
+           frame);
+    wl_buffer_destroy(img->buffer);
+    close(img->fd);
+  }
+
+  VkFormat oldFormat = WSI.vk.swapFormat;
+  int32_t picked = dmabuf_format_pick();
+  // Checked at startup, but a later batch of feedback may take it away.
+  if (picked == -1)
+    fprintf(stderr, "the compositor imports none of our formats\n");
+  assert(picked != -1);
+  if (WSI.vk.swapFormat != oldFormat)
+    format_report(picked);
+
+  DMABUF.generation++;
+  memset(DMABUF.busy, 0, sizeof(DMABUF.busy));
+  WSI.vk.imgCount = OPTS.dmabuf_buffers;
+  free(WSI.vk.img);
+  WSI.vk.img = calloc(WSI.vk.imgCount, sizeof(*WSI.vk.img));
+  assert(WSI.vk.img);
+  for (uint32_t i = 0; i < WSI.vk.imgCount; i++)
+    dmabuf_buffer_new(i);
+}
+
+// swapchain_init for our own buffers. There is no surface to ask, anything
+// the device can make goes.
+void dmabuf_init(uint32_t maxExtent) {
+  caps_fake((VkExtent2D){maxExtent, maxExtent});
+  DMABUF.syncFile = true;
+  // The blit would need the image's layout to be ours to pick.
+  if (OPTS.dynamic_res)
+    fprintf(stderr, "no dynamic resolution with --dmabuf\n");
+  OPTS.dynamic_res = false;
+  dmabuf_create(0);
+  opaque_region_set(WSI.surface);
+}
+
+int32_t dmabuf_acquire() {
+  return pool_acquire(DMABUF.busy, WSI.vk.imgCount);
+}
+
+void dmabuf_no_sync_file() {
+  fprintf(stderr, "no dma-buf sync_file ioctls, commits wait for the GPU\n");
+  DMABUF.syncFile = false;
+}
+
+// Make semaphore wait for the compositor's reads of img, as taken from the
+// dmabuf's implicit fences. Returns false if there is nothing to wait for.
+bool dmabuf_fence_in(struct swap_image *img, VkSemaphore semaphore) {
+  if (!img->foreign || !DMABUF.syncFile)
+    return false;
+  // Writers wait for every fence, readers too.
+  struct dma_buf_export_sync_file fence = {.flags = DMA_BUF_SYNC_WRITE,
+                                           .fd = -1};
+  if (ioctl(img->fd, DMA_BUF_IOCTL_EXPORT_SYNC_FILE, &fence) != 0) {
+    dmabuf_no_sync_file();
+    return false;
+  }
+  VkImportSemaphoreFdInfoKHR importInfo = {0};
+  importInfo.sType = VK_STRUCTURE_TYPE_IMPORT_SEMAPHORE_FD_INFO_KHR;
+  importInfo.semaphore = semaphore;
+  importInfo.flags = VK_SEMAPHORE_IMPORT_TEMPORARY_BIT;
+  importInfo.handleType = VK_EXTERNAL_SEMAPHORE_HANDLE_TYPE_SYNC_FD_BIT;
+  importInfo.fd = fence.fd;
+  VkResult result = VK.vkImportSemaphoreFdKHR(VK.dev, &importInfo);
+  assert(result == VK_SUCCESS);
+  return true;
+}
+
+// Attach the submit's renderFinished to img's dmabuf as its write fence, so
+// the compositor's implicit sync waits for our rendering. Exporting resets
+// the semaphore for the next submit.
+bool dmabuf_fence_out(struct swap_image *img) {
+  VkSemaphoreGetFdInfoKHR getInfo = {0};
+  getInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_GET_FD_INFO_KHR;
+  getInfo.semaphore = img->renderFinished;
+  getInfo.handleType = VK_EXTERNAL_SEMAPHORE_HANDLE_TYPE_SYNC_FD_BIT;
+  int fd;
+  VkResult result = VK.vkGetSemaphoreFdKHR(VK.dev, &getInfo, &fd);
+  assert(result == VK_SUCCESS);
+  // Already signalled.
+  if (fd == -1)
+    return true;
+  struct dma_buf_import_sync_file fence = {.flags = DMA_BUF_SYNC_WRITE,
+                                           .fd = fd};
+  bool ok = ioctl(img->fd, DMA_BUF_IOCTL_IMPORT_SYNC_FILE, &fence) == 0;
+  close(fd);
+  return ok;
+}
+
+// Hand image over to the compositor after drawing, or take it back before
+// drawing over what it holds. It stays GENERAL, the one layout another driver
+// knows about.
+void dmabuf_barrier(VkCommandBuffer cmd, VkImage image, bool acquire) {
+  VkImageMemoryBarrier barrier = {0};
+  barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+  barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+  barrier.srcQueueFamilyIndex =
+      acquire ? VK_QUEUE_FAMILY_FOREIGN_EXT : (uint32_t)VK.gfxIdx;
+  barrier.dstQueueFamilyIndex =
+      acquire ? (uint32_t)VK.gfxIdx : VK_QUEUE_FAMILY_FOREIGN_EXT;
+  barrier.image = image;
+  barrier.subresourceRange =
+      (VkImageSubresourceRange){VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+  if (acquire)
+    barrier.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT |
+                            VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+  else
+    barrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+  vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                       acquire ? VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT
+                               : VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                       0, 0, NULL, 0, NULL, 1, &barrier);
+}
+
+// vkQueuePresentKHR for our own buffers, the commit goes out with whatever
+// the caller set on the surface. The compositor must not read img before
+// f's submit is done: that is the dmabuf's fence with sync_files, else we
+// wait for it here.
+void dmabuf_commit(struct frame *f, struct swap_image *img, VkRect2D changed) {
+  if (DMABUF.syncFile && !dmabuf_fence_out(img))
+    dmabuf_no_sync_file();
+  if (!DMABUF.syncFile)
+    vkWaitForFences(VK.dev, 1, &f->inFlight, VK_TRUE, UINT64_MAX);
+  wl_surface_attach(WSI.surface, img->buffer, 0, 0);
+  if (DAMAGE.incremental)
+    wl_surface_damage_buffer(WSI.surface, changed.offset.x, changed.offset.y,
+                             changed.extent.width, changed.extent.height);
+  else
+    wl_surface_damage_buffer(WSI.surface, 0, 0, INT32_MAX, INT32_MAX);
+  wl_surface_commit(WSI.surface);
+  // The wayland thread may be asleep, this is what the WSI does too.
+  wl_display_flush(WSI.display);
+  DMABUF.busy[img - WSI.vk.img] = true;
+}
+
+void dmabuf_stats() {
+  printf("dmabuf: %u buffers, modifier 0x%016" PRIx64
+         ", all held %" PRIu64 " times, %s\n",
+         WSI.vk.imgCount, DMABUF.modifier, DMABUF.exhausted,
+         DMABUF.syncFile ? "implicit sync" : "CPU waits");
+}
+
+// CPU rasterizer
+
+// Encoded to 8 bits like an sRGB swapchain format does.
+uint8_t srgb_u8(float linear) {
+  return (uint8_t)(srgb_u32(linear) / (double)0x01010101 + 0.5);
+}
+
+// Where the triangle lands on a w by h frame: its edges, bounding box and
+// colours scaled for interpolating with the edges.
+void raster_setup(int32_t w, int32_t h, const struct MData *spin,
+                  bool pressed) {
+  // The vertex shader and viewport, vulkan's y points down like ours.
+  const float *m = spin->m;
+  float x[3], y[3];
+  for (uint32_t i = 0; i < 3; i++) {
+    float p1 = vertexIn[i].pos.p1, p2 = vertexIn[i].pos.p2;
+    x[i] = (m[0] * p1 + m[4] * p2 + m[12] + 1) * 0.5f * w;
+    y[i] = (m[1] * p1 + m[5] * p2 + m[13] + 1) * 0.5f * h;
+  }
+
+  // Edge i runs between the other two vertices, 0 on them and twice the
+  // area at vertex i. Flipped if need be so the inside is positive.
+  struct raster_edge *e = RASTER.edge;
+  for (uint32_t i = 0; i < 3; i++) {
+    uint32_t j = (i + 1) % 3, k = (i + 2) % 3;
+    e[i].a = y[j] - y[k];
+    e[i].b = x[k] - x[j];
+    e[i].c = -(e[i].a * x[j] + e[i].b * y[j]);
+  }
+  float area = e[0].a * x[0] + e[0].b * y[0] + e[0].c;
+  for (uint32_t i = 0; area < 0 && i < 3; i++) {
+    e[i].a = -e[i].a;
+    e[i].b = -e[i].b;
+    e[i].c = -e[i].c;
+  }
+  area = fabsf(area);
+  // The top-left rule, shared edges are drawn once. y points down.
+  for (uint32_t i = 0; i < 3; i++)
+    e[i].topLeft = e[i].a > 0 || (e[i].a == 0 && e[i].b > 0);
+  for (uint32_t i = 0; i < 3; i++) {
+    const float col[3] = {vertexIn[i].col.c1, vertexIn[i].col.c2,
+                          vertexIn[i].col.c3};
+    for (uint32_t c = 0; c < 3; c++)
+      RASTER.col[i][c] = area > 0 ? col[c] / area : 0;
+  }
+
+  float minX = MIN(MIN(x[0], x[1]), x[2]), maxX = MAX(MAX(x[0], x[1]), x[2]);
+  float minY = MIN(MIN(y[0], y[1]), y[2]), maxY = MAX(MAX(y[0], y[1]), y[2]);
+  RASTER.x0 = CLAMP(floorf(minX), 0, w);
+  RASTER.x1 = CLAMP(ceilf(maxX), 0, w);
+  RASTER.y0 = CLAMP(floorf(minY), 0, h);
+  RASTER.y1 = CLAMP(ceilf(maxY), 0, h);
+  // Nothing to draw.
+  if (area <= 0)
+    RASTER.x1 = RASTER.x0;
+
+  const float *c = clearColors[pressed];
+  RASTER.clear = 0xff000000u | srgb_u8(c[0]) << 16 | srgb_u8(c[1]) << 8 |
+                 srgb_u8(c[2]);
+}
+
+#ifndef __SSE2__
+// The colour at a pixel from its edge functions.
+uint32_t raster_shade(const float ev[3]) {
+  uint32_t pixel = 0xff000000u;
+  for (uint32_t c = 0; c < 3; c++) {
+    float v = ev[0] * RASTER.col[0][c] + ev[1] * RASTER.col[1][c] +
+              ev[2] * RASTER.col[2][c];
+    v = CLAMP(v, 0.0f, 1.0f);
+    pixel |= (uint32_t)RASTER.srgb[(int32_t)(v * 4095 + 0.5f)]
+             << (16 - 8 * c);
+  }
+  return pixel;
+}
+#endif
+
+// The triangle's pixels between x0 and x1 on row y.
+void raster_span(uint32_t *row, int32_t y, int32_t x0, int32_t x1) {
+  const struct raster_edge *e = RASTER.edge;
+  float py = y + 0.5f;
+#ifdef __SSE2__
+  // Four pixels at a time, the edge functions step by 4 A.
+  __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+  __m128 lut = _mm_set1_ps(4095.0f);
+  __m128 px = _mm_add_ps(_mm_set1_ps(x0 + 0.5f), _mm_setr_ps(0, 1, 2, 3));
+  __m128 end = _mm_set1_ps((float)x1);
+  __m128 ev[3], step[3], col[3][3];
+  for (uint32_t i = 0; i < 3; i++) {
+    ev[i] = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(e[i].a), px),
+                       _mm_set1_ps(e[i].b * py + e[i].c));
+    step[i] = _mm_set1_ps(4 * e[i].a);
+    for (uint32_t c = 0; c < 3; c++)
+      col[i][c] = _mm_set1_ps(RASTER.col[i][c]);
+  }
+  for (int32_t x = x0; x < x1; x += 4) {
+    // Past x1 is another tile's.
+    __m128 in = _mm_cmplt_ps(px, end);
+    for (uint32_t i = 0; i < 3; i++)
+      in = _mm_and_ps(in, e[i].topLeft ? _mm_cmpge_ps(ev[i], zero)
+                                       : _mm_cmpgt_ps(ev[i], zero));
+    int mask = _mm_movemask_ps(in);
+    if (mask) {
+      int32_t idx[3][4];
+      for (uint32_t c = 0; c < 3; c++) {
+        __m128 v = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ev[0], col[0][c]),
+                                         _mm_mul_ps(ev[1], col[1][c])),
+                              _mm_mul_ps(ev[2], col[2][c]));
+        v = _mm_min_ps(_mm_max_ps(v, zero), one);
+        _mm_storeu_si128((__m128i *)idx[c],
+                         _mm_cvtps_epi32(_mm_mul_ps(v, lut)));
+      }
+      for (uint32_t k = 0; k < 4; k++) {
+        if (mask & (1 << k))
+          row[x + k] = 0xff000000u | RASTER.srgb[idx[0][k]] << 16 |
+                       RASTER.srgb[idx[1][k]] << 8 | RASTER.srgb[idx[2][k]];
+      }
+    }
+    px = _mm_add_ps(px, _mm_set1_ps(4.0f));
+    for (uint32_t i = 0; i < 3; i++)
+      ev[i] = _mm_add_ps(ev[i], step[i]);
+  }
+#else
+  for (int32_t x = x0; x < x1; x++) {
+    float ev[3];
+    bool in = true;
+    for (uint32_t i = 0; i < 3; i++) {
+      ev[i] = e[i].a * (x + 0.5f) + e[i].b * py + e[i].c;
+      in &= e[i].topLeft ? ev[i] >= 0 : ev[i] > 0;
+    }
+    if (in)
+      row[x] = raster_shade(ev);
+  }
+#endif
+}
+
+// Clear a tile and draw what of the triangle falls in it.
+void raster_tile(uint32_t tile) {
+  int32_t tx = tile % RASTER.tilesX * RASTER_TILE;
+  int32_t ty = tile / RASTER.tilesX * RASTER_TILE;
+  int32_t tx1 = MIN(tx + RASTER_TILE, RASTER.w);
+  int32_t ty1 = MIN(ty + RASTER_TILE, RASTER.h);
+  for (int32_t y = ty; y < ty1; y++) {
+    uint32_t *row = RASTER.pixels + (size_t)y * RASTER.w;
+    for (int32_t x = tx; x < tx1; x++)
+      row[x] = RASTER.clear;
+  }
+  int32_t x0 = MAX(tx, RASTER.x0), x1 = MIN(tx1, RASTER.x1);
+  int32_t y0 = MAX(ty, RASTER.y0), y1 = MIN(ty1, RASTER.y1);
+  for (int32_t y = y0; x0 < x1 && y < y1; y++)
+    raster_span(RASTER.pixels + (size_t)y * RASTER.w, y, x0, x1);
+}
+
+// Take tiles until there are none left.
+void raster_work() {
+  uint32_t tile;
+  while ((tile = atomic_fetch_add(&RASTER.nextTile, 1)) < RASTER.tileCount)
+    raster_tile(tile);
+}
+
+void *raster_thread(void *arg) {
+  uint64_t seen = 0;
+  pthread_mutex_lock(&RASTER.lock);
+  for (;;) {
+    while (RASTER.job == seen && !RASTER.quit)
+      pthread_cond_wait(&RASTER.start, &RASTER.lock);
+    if (RASTER.quit)
+      break;
+    seen = RASTER.job;
+    pthread_mutex_unlock(&RASTER.lock);
+    raster_work();
+    pthread_mutex_lock(&RASTER.lock);
+    if (--RASTER.active == 0)
+      pthread_cond_signal(&RASTER.done);
+  }
+  pthread_mutex_unlock(&RASTER.lock);
+  return NULL;
+}
+
+// A worker for every other core, the render thread does its share.
+void raster_init() {
+  for (uint32_t i = 0; i < ARRAY_SIZEOF(RASTER.srgb); i++)
+    RASTER.srgb[i] = srgb_u8(i / 4095.0f);
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  RASTER.threadCount = CLAMP(cpus - 1, 0, RASTER_MAX_THREADS);
+  pthread_mutex_init(&RASTER.lock, NULL);
+  pthread_cond_init(&RASTER.start, NULL);
+  pthread_cond_init(&RASTER.done, NULL);
+  for (uint32_t i = 0; i < RASTER.threadCount; i++) {
+    int ret = pthread_create(&RASTER.thread[i], NULL, raster_thread, NULL);
+    assert(ret == 0);
+  }
+}
+
+// Draw the frame into w by h packed XRGB8888 pixels, returns once every tile
+// is done.
+void raster_draw(uint32_t *pixels, int32_t w, int32_t h,
+                 const struct MData *spin, bool pressed) {
+  TRACE_SCOPE("raster");
+  raster_setup(w, h, spin, pressed);
+  RASTER.pixels = pixels;
+  RASTER.w = w;
+  RASTER.h = h;
+  RASTER.tilesX = (w + RASTER_TILE - 1) / RASTER_TILE;
+  RASTER.tileCount = RASTER.tilesX * ((h + RASTER_TILE - 1) / RASTER_TILE);
+  atomic_store(&RASTER.nextTile, 0);
+
+  pthread_mutex_lock(&RASTER.lock);
+  RASTER.active = RASTER.threadCount;
+  RASTER.job++;
+  pthread_cond_broadcast(&RASTER.start);
+  pthread_mutex_unlock(&RASTER.lock);
+  raster_work();
+  pthread_mutex_lock(&RASTER.lock);
+  while (RASTER.active)
+    pthread_cond_wait(&RASTER.done, &RASTER.lock);
+  pthread_mutex_unlock(&RASTER.lock);
+}
+
+// Stop the workers, they are idle between frames.
+void raster_finish() {
+  pthread_mutex_lock(&RASTER.lock);
+  RASTER.quit = true;
+  pthread_cond_broadcast(&RASTER.start);
+  pthread_mutex_unlock(&RASTER.lock);
+  for (uint32_t i = 0; i < RASTER.threadCount; i++)
+    pthread_join(RASTER.thread[i], NULL);
+}
+
+// Shared memory buffers
+
+// SHM_BUFFERS buffers at swapSize() in a new memfd. The compositor keeps its
+// own mapping for whichever old buffer it still shows.
+void shm_create() {
+  TRACE_SCOPE("shm_create");
+  for (uint32_t i = 0; i < SHM_BUFFERS; i++) {
+    if (SHM.buf[i].buffer)
+      wl_buffer_destroy(SHM.buf[i].buffer);
+  }
+  if (SHM.data)
+    munmap(SHM.data, SHM.size);
+
+  VkExtent2D size = swapSize();
+  SHM.w = size.width;
+  SHM.h = size.height;
+  size_t bytes = (size_t)SHM.w * SHM.h * 4;
+  SHM.size = bytes * SHM_BUFFERS;
+  int fd = memfd_create("vkwayland-shm", MFD_CLOEXEC);
+  assert(fd != -1);
+  int ret = ftruncate(fd, SHM.size);
+  assert(ret == 0);
+  SHM.data = mmap(NULL, SHM.size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  assert(SHM.data != MAP_FAILED);
+
+  struct wl_shm_pool *pool = wl_shm_create_pool(WSI.shm, fd, SHM.size);
+  SHM.generation++;
+  for (uint32_t i = 0; i < SHM_BUFFERS; i++) {
+    SHM.buf[i].pixels = (uint32_t *)((char *)SHM.data + i * bytes);
+    SHM.buf[i].buffer =
+        wl_shm_pool_create_buffer(pool, i * bytes, SHM.w, SHM.h, SHM.w * 4,
+                                  WL_SHM_FORMAT_XRGB8888);
+    SHM.busy[i] = false;
+    wl_buffer_add_listener(
+        SHM.buf[i].buffer, &buffer_listener,
+        (void *)(uintptr_t)((uint64_t)SHM.generation << 8 | i));
+  }
+  wl_shm_pool_destroy(pool);
+  close(fd);
+}
+
+int32_t shm_acquire() {
+  return pool_acquire(SHM.busy, SHM_BUFFERS);
+}
+
+void shm_stats() {
+  printf("cpu: %u threads, %d buffers all held %" PRIu64 " times\n",
+         RASTER.threadCount + 1, SHM_BUFFERS, SHM.exhausted);
+}
+
+// From UNDEFINED for full redraws, partial ones keep what is outside the
+// render area.
+VkRenderPass render_pass_new(VkFormat format, VkImageLayout initialLayout,
+                             VkImageLayout finalLayout) {
+  VkAttachmentDescription colorAttachment = {0};
+  // Remade by the render loop if the swapchain format changes.
+  colorAttachment.format = format;
+  colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+  colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+  colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+  colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+  colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+  colorAttachment.initialLayout = initialLayout;
+  colorAttachment.finalLayout = finalLayout;
+
+  VkAttachmentReference colorAttachmentRef = {0};
+  colorAttachmentRef.attachment = 0; // location = 0 output.
+  colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+  VkSubpassDescription subpass = {0};
+  subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+  subpass.colorAttachmentCount = 1;
+  subpass.pColorAttachments = &colorAttachmentRef;
+
+  VkSubpassDependency dependency = {0};
+  // subpass 0 color attachment has a write dependency against ...
+  dependency.dstSubpass = 0;
+  dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+  dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+  // swapchain's external access of color attachments.
+  dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+  dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+  dependency.srcAccessMask = 0;
+
+  VkRenderPassCreateInfo renderPassInfo = {0};
+  renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+  renderPassInfo.attachmentCount = 1;
+  renderPassInfo.pAttachments = &colorAttachment;
+  renderPassInfo.subpassCount = 1;
+  renderPassInfo.pSubpasses = &subpass;
+  renderPassInfo.dependencyCount = 1;
+  renderPassInfo.pDependencies = &dependency;
+
+  VkRenderPass renderPass;
+  VkResult result =
+      vkCreateRenderPass(VK.dev, &renderPassInfo, NULL, &renderPass);
+  assert(result == VK_SUCCESS);
+  return renderPass;
+}
+
+void usage(const char *name) {
+  printf("Usage: %s [options]\n"
+         "  --loop-stats          print event loop wakeups and cpu use every "
+         "second\n"
+         "  --frames-in-flight N  frames the CPU may run ahead of the GPU "
+         "(1-%d, default 2)\n"
+         "  --no-pace             render on every frame callback instead of "
+         "just before the vblank\n"
+         "  --pace-margin MS      time left for the compositor before the "
+         "vblank (default 2)\n"
+         "  --present-mode MODE   fifo, relaxed, mailbox or immediate "
+         "(default fifo)\n"
+         "                        mailbox and immediate draw uncapped\n"
+         "  --max-queued K        wait for presents until at most K are "
+         "queued for display\n"
+         "  --tearing             allow tearing for the lowest latency, "
+         "overrides --present-mode\n"
+         "  --scheduled           queue timed presents on the compositor "
+         "instead of blocking\n"
+         "  --headless N          render N offscreen frames as fast as "
+         "possible, no compositor\n"
+         "  --stage-stats         print per stage frame times at exit, "
+         "SIGUSR1 prints them any time\n"
+         "  --stage-json FILE     dump the raw stage times with every "
+         "report\n"
+         "  --surface-format F    8bit, 10bit or fp16 (default 8bit), "
+         "falls back to 8bit\n"
+         "  --input-rate HZ       fake this many inputs a second, for "
+         "compositors without a\n"
+         "                        seat such as weston --backend=headless\n"
+         "  --render-scale S      draw S times the output's pixels, "
+         "0.25 to 2 (default 1)\n"
+         "  --dynamic-res         draw below full size when the GPU can't "
+         "keep up\n"
+         "  --no-damage           redraw and present the whole window every "
+         "frame\n"
+         "  --dmabuf N            present N buffers of our own instead of "
+         "a swapchain (2-8)\n"
+         "  --cpu                 rasterize on the CPU into shared memory, "
+         "also without vulkan\n"
+         "                        with --headless compare it against a "
+         "vulkan software driver\n"
+#ifdef TRACE
+         "  --trace FILE          where the trace goes at exit "
+         "(default trace.json)\n"
+#endif
+         ,
+         name, MAX_FRAMES_IN_FLIGHT);
+}
+
+// Frame pacing
+
+void cost_push(struct cost_history *h, uint64_t ns) {
+  h->ns[h->count++ % COST_HISTORY] = ns;
+}
+
+uint64_t cost_worst(const struct cost_history *h) {
+  uint64_t worst = 0;
+  for (uint32_t i = 0; i < h->count && i < COST_HISTORY; i++)
+    worst = MAX(worst, h->ns[i]);
+  return worst;
+}
+
+// How long before its vblank a frame has to start.
+uint64_t pace_budget() {
+  return cost_worst(&PACE.cpu) + cost_worst(&PACE.gpu) + OPTS.pace_margin;
+}
+
+// The first vblank from earliest on which no earlier frame is aimed at,
+// predicted from the last presented frame. 0 until we have seen one.
+uint64_t pace_next_vblank(uint64_t earliest) {
+  if (!PACE.refresh || !PACE.lastPresent)
+    return 0;
+
+  uint64_t refresh = PACE.refresh;
+  earliest = MAX(earliest, PACE.lastTarget + refresh / 2);
+  uint64_t target = PACE.lastPresent;
+  if (earliest > target)
+    target += (earliest - target + refresh - 1) / refresh * refresh;
+
+  return target;
+}
+
+// Aim the next frame at the earliest vblank it can still make and sleep until
+// just in time for it.
+void pace_schedule() {
+  uint64_t now = now_ns();
+  uint64_t budget = pace_budget();
+  uint64_t target = pace_next_vblank(now + budget);
+  // Nothing to predict from yet, just draw.
+  if (!target) {
+    PACE.due = true;
+    return;
+  }
+
+  PACE.target = target;
+  PACE.wake = target - budget;
+  if (PACE.wake <= now)
+    PACE.due = true;
+  else
+    timer_arm(PACE.timerfd, PACE.wake, 0);
+}
+
+// The wake up timer fired. If we got scheduled too late to make the target
+// skip to the next vblank rather than present late.
+void pace_wake() {
+  if (now_ns() > PACE.wake + OPTS.pace_margin / 2) {
+    pace_schedule();
+    return;
+  }
+  PACE.due = true;
+}
+
+void pace_presented(const struct render_event *ev) {
+  if (!ev->time) {
+    PACE.discarded++;
+    return;
+  }
+  PACE.presented++;
+  uint64_t previous = PACE.lastPresent;
+  PACE.lastPresent = MAX(PACE.lastPresent, ev->time);
+  if (ev->refresh)
+    PACE.refresh = ev->refresh;
+
+  uint64_t target = PACE.targets[ev->id % PACE_TARGETS];
+  // Vblanks we let go by because the frame could not be ready for them,
+  // counted once per presented frame however often it was rescheduled.
+  uint32_t refresh = PACE.refresh;
+  if (target && previous && refresh && target > previous + refresh * 3 / 2)
+    PACE.skipped += (target - previous - refresh / 2) / refresh;
+  if (target && ev->time > target + PACE.refresh / 2)
+    PACE.missed++;
+}
+
+void pace_stats() {
+  printf("pacing: %" PRIu64 " presented, %" PRIu64 " discarded, %" PRIu64
+         " missed, %" PRIu64 " skipped, cpu %.2fms, gpu %.2fms\n",
+         PACE.presented, PACE.discarded, PACE.missed, PACE.skipped,
+         cost_worst(&PACE.cpu) / 1e6, cost_worst(&PACE.gpu) / 1e6);
+}
+
+// Resizing
+
+// Rebuilds are allocations in the driver and compositor, while an edge is
+// dragged make at most this many a second and scale the last one meanwhile.
+#define RESIZE_REBUILD_NS 100000000ull
+
+// Pick what the swapchain should be made at for the window, flagging a
+// rebuild when it is time for one.
+void resize_update() {
+  int32_t w = WSI.vk.winW, h = WSI.vk.winH;
+  // Exactly the output's pixels, rounded half away from zero as the
+  // compositor does, or the share of them --render-scale affords. The
+  // viewport puts it back at window size either way.
+  if (WSI.viewport) {
+    double scale = WSI.vk.scale / 120.0 * OPTS.render_scale;
+    w = MAX((int32_t)(w * scale + 0.5), 1);
+    h = MAX((int32_t)(h * scale + 0.5), 1);
+  }
+  bool scaling = WSI.viewport && WSI.vk.resizing;
+  // Nobody studies the content mid drag, draw a quarter of the pixels.
+  if (scaling) {
+    w = MAX((w + 1) / 2, 1);
+    h = MAX((h + 1) / 2, 1);
+  }
+  if (w == WSI.vk.w && h == WSI.vk.h)
+    return;
+  uint64_t now = now_ns();
+  if (scaling && now - WSI.vk.lastRebuild < RESIZE_REBUILD_NS)
+    return;
+  WSI.vk.w = w;
+  WSI.vk.h = h;
+  WSI.vk.recreate = true;
+  WSI.vk.lastRebuild = now;
+}
+
+// Stretch whatever the swapchain holds over the window, goes out with the
+// next present's commit.
+void viewport_update() {
+  if (!WSI.viewport)
+    return;
+  VkExtent2D size = swapSize();
+  int32_t w = WSI.vk.winW, h = WSI.vk.winH;
+  if (size.width == (uint32_t)w && size.height == (uint32_t)h)
+    w = h = 0;
+  if (w == WSI.vk.viewW && h == WSI.vk.viewH)
+    return;
+  wp_viewport_set_destination(WSI.viewport, w ? w : -1, h ? h : -1);
+  WSI.vk.viewW = w;
+  WSI.vk.viewH = h;
+}
+
+// Dynamic resolution
+
+// Frames between adjustments. GPU times come back frames in flight late, this
+// gives each adjustment a few of its own.
+#define DYNRES_INTERVAL 8
+// Share of the refresh interval the GPU may take, the rest is the
+// compositor's and slack for spikes.
+#define DYNRES_HEADROOM 0.75
+#define DYNRES_MIN 0.5f
+// Dropping happens at once so a spike doesn't cost frames, going back up is
+// this much per adjustment so we don't oscillate around the budget.
+#define DYNRES_STEP 0.05f
+
+// A frame drawn at scale took gpu ns. Cost goes with the pixels so scale it
+// up to what full size would have taken, which any scale can be picked from.
+void dynres_sample(uint64_t gpu, float scale) {
+  DYNRES.worst = MAX(DYNRES.worst, (uint64_t)(gpu / (scale * scale)));
+}
+
+// Every DYNRES_INTERVAL frames pick the scale whose worst frame fits.
+void dynres_update() {
+  if (!DYNRES.enabled || ++DYNRES.frames < DYNRES_INTERVAL || !DYNRES.worst)
+    return;
+  double budget = (PACE.refresh ? PACE.refresh : 16666667) * DYNRES_HEADROOM;
+  float scale = sqrt(budget / DYNRES.worst);
+  float highest = MIN(DYNRES.scale + DYNRES_STEP, 1.0f);
+  scale = CLAMP(scale, DYNRES_MIN, highest);
+  DYNRES.frames = 0;
+  DYNRES.worst = 0;
+  if (fabsf(scale - DYNRES.scale) < 0.01f)
+    return;
+  DYNRES.scale = scale;
+  DYNRES.changes++;
+  DYNRES.lowest = MIN(DYNRES.lowest, scale);
+}
+
+// What the next frame is drawn at.
+VkExtent2D dynres_size() {
+  VkExtent2D size = swapSize();
+  size.width = MAX((uint32_t)(size.width * DYNRES.scale + 0.5f), 1);
+  size.height = MAX((uint32_t)(size.height * DYNRES.scale + 0.5f), 1);
+  return size;
+}
+
+// Give each frame slot a swapchain sized target, retiring the old ones behind
+// frame. Any scale fits so they only change with the swapchain.
+void scene_create(VkRenderPass renderPass, uint64_t frame) {
+  for (uint32_t i = 0; i < RENDER.frameCount; i++) {
+    struct frame *f = &RENDER.frame[i];
+    if (f->scene) {
+      retire((struct retired){RETIRED_FRAMEBUFFER, .fb = f->sceneFb}, frame);
+      retire((struct retired){RETIRED_IMAGE_VIEW, .view = f->sceneView},
+             frame);
+      retire((struct retired){RETIRED_IMAGE, .image = f->scene}, frame);
+      retire((struct retired){RETIRED_ALLOCATION, .alloc = f->sceneAlloc},
+             frame);
+      f->scene = VK_NULL_HANDLE;
+    }
+    if (!DYNRES.enabled)
+      continue;
+    f->scene = image_new(WSI.vk.swapFormat,
+                         VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+                             VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+                         &f->sceneAlloc);
+    f->sceneView = image_view_new(f->scene, WSI.vk.swapFormat);
+    f->sceneFb = framebuffer_new(renderPass, f->sceneView);
+  }
+}
+
+// Stretch the size corner of scene over all of the swapchain image dst. The
+// scene render pass left it in TRANSFER_SRC, dst comes straight from acquire
+// (whose semaphore the submit waits for at the transfer stage) and is left
+// ready to present.
+void dynres_blit(VkCommandBuffer cmd, VkImage scene, VkImage dst,
+                 VkExtent2D size) {
+  VkImageSubresourceRange range = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+  VkImageMemoryBarrier before[2] = {0};
+  before[0].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  before[0].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+  before[0].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+  before[0].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+  before[0].newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+  before[0].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  before[0].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  before[0].image = scene;
+  before[0].subresourceRange = range;
+  before[1] = before[0];
+  before[1].srcAccessMask = 0;
+  before[1].dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  before[1].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  before[1].newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+  before[1].image = dst;
+  vkCmdPipelineBarrier(cmd,
+                       VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
+                           VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 0, NULL,
+                       ARRAY_SIZEOF(before), before);
+
+  VkExtent2D full = swapSize();
+  VkImageBlit blit = {0};
+  blit.srcSubresource = (VkImageSubresourceLayers){VK_IMAGE_ASPECT_COLOR_BIT,
+                                                   0, 0, 1};
+  blit.srcOffsets[1] = (VkOffset3D){size.width, size.height, 1};
+  blit.dstSubresource = blit.srcSubresource;
+  blit.dstOffsets[1] = (VkOffset3D){full.width, full.height, 1};
+  vkCmdBlitImage(cmd, scene, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, dst,
+                 VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit,
+                 VK_FILTER_LINEAR);
+
+  VkImageMemoryBarrier after = before[1];
+  after.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  after.dstAccessMask = 0;
+  after.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+  after.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+  vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, NULL, 0,
+                       NULL, 1, &after);
+}
+
+void dynres_stats() {
+  printf("dynamic resolution: %u changes, lowest %.0f%%, last %.0f%%\n",
+         DYNRES.changes, DYNRES.lowest * 100, DYNRES.scale * 100);
+}
+
+// Damage tracking
+
+VkRect2D rect_union(VkRect2D a, VkRect2D b) {
+  int32_t x0 = MIN(a.offset.x, b.offset.x);
+  int32_t y0 = MIN(a.offset.y, b.offset.y);
+  int32_t x1 = MAX(a.offset.x + a.extent.width, b.offset.x + b.extent.width);
+  int32_t y1 = MAX(a.offset.y + a.extent.height, b.offset.y + b.extent.height);
+  return (VkRect2D){{x0, y0}, {x1 - x0, y1 - y0}};
+}
+
+// The pixels a box in normalized device coordinates touches on an image of
+// size, with one more each way for rounding and clamped to the image.
+VkRect2D damage_box(float x0, float y0, float x1, float y1, VkExtent2D size) {
+  int32_t px0 = floorf((x0 + 1) / 2 * size.width) - 1;
+  int32_t py0 = floorf((y0 + 1) / 2 * size.height) - 1;
+  int32_t px1 = ceilf((x1 + 1) / 2 * size.width) + 1;
+  int32_t py1 = ceilf((y1 + 1) / 2 * size.height) + 1;
+  px0 = CLAMP(px0, 0, (int32_t)size.width);
+  py0 = CLAMP(py0, 0, (int32_t)size.height);
+  px1 = CLAMP(px1, px0, (int32_t)size.width);
+  py1 = CLAMP(py1, py0, (int32_t)size.height);
+  return (VkRect2D){{px0, py0}, {px1 - px0, py1 - py0}};
+}
+
+// Drawing box into img with the pressed clear colour. Narrows *area to what
+// the image needs redrawn and *changed to what differs from the last present,
+// both start out as the whole image. Returns whether *area is partial, the
+// image then has to be drawn with a render pass that keeps the rest.
+bool damage_frame(struct swap_image *img, bool pressed, VkRect2D box,
+                  VkRect2D *area, VkRect2D *changed) {
+  bool partial = img->drawn && img->pressed == pressed;
+  if (partial)
+    *area = rect_union(img->box, box);
+  if (DAMAGE.valid && DAMAGE.pressed == pressed)
+    *changed = rect_union(DAMAGE.box, box);
+  img->drawn = DAMAGE.valid = true;
+  img->pressed = DAMAGE.pressed = pressed;
+  img->box = DAMAGE.box = box;
+  return partial;
+}
+
+void damage_stats() {
+  printf("damage: redrew %.1f%% of the pixels, %s\n",
+         DAMAGE.total ? 100.0 * DAMAGE.drawn / DAMAGE.total : 100.0,
+         !DAMAGE.incremental ? "full surface damage"
+         : WSI.vk.dmabuf     ? "buffer damage"
+                             : "incremental present");
+}
+
+// Input latency
+
+// Frame id takes whatever input arrived since the last one.
+void latency_consume(uint64_t id) {
+  uint64_t seq = atomic_load(&RENDER.inputSeq);
+  LATENCY.frame[id % PACE_TARGETS] = id;
+  LATENCY.arrival[id % PACE_TARGETS] = atomic_exchange(&RENDER.inputArrival, 0);
+  LATENCY.inputs[id % PACE_TARGETS] = seq - LATENCY.lastSeq;
+  LATENCY.lastSeq = seq;
+}
+
+void latency_presented(const struct render_event *ev) {
+  if (LATENCY.frame[ev->id % PACE_TARGETS] != ev->id)
+    return; // Slot reused by a later frame before this one's feedback.
+  uint64_t arrival = LATENCY.arrival[ev->id % PACE_TARGETS];
+  uint64_t inputs = LATENCY.inputs[ev->id % PACE_TARGETS];
+  if (!arrival)
+    return;
+  LATENCY.arrival[ev->id % PACE_TARGETS] = 0;
+  if (!ev->time) {
+    LATENCY.discarded += inputs;
+    return;
+  }
+  LATENCY.drawn += inputs;
+  LATENCY.ns[LATENCY.count++ % LATENCY_SAMPLES] = ev->time - arrival;
+}
+
+// Labelled with what is being compared, so runs can be diffed.
+void latency_report() {
+  static uint64_t v[LATENCY_SAMPLES];
+  uint32_t n = MIN(LATENCY.count, LATENCY_SAMPLES);
+  const char *strategy = WSI.fifo          ? "scheduled"
+                         : RENDER.uncapped ? "uncapped"
+                         : PACE.enabled    ? "paced"
+                                           : "callbacks";
+  printf("input latency (%s, %s): %" PRIu64 " inputs shown, %" PRIu64
+         " discarded\n",
+         present_mode_name(WSI.vk.presentMode), strategy, LATENCY.drawn,
+         LATENCY.discarded);
+  if (!n)
+    return;
+  memcpy(v, LATENCY.ns, n * sizeof(v[0]));
+  qsort(v, n, sizeof(v[0]), cmp_u64);
+  printf("  latency   p50 %.3fms  p90 %.3fms  p99 %.3fms  max %.3fms\n",
+         percentile(v, n, 50) / 1e6, percentile(v, n, 90) / 1e6,
+         percentile(v, n, 99) / 1e6, v[n - 1] / 1e6);
+}
+
+// Apply everything the wayland thread sent us, waiting up to timeout_ms for
+// the first event.
+void render_poll(int timeout_ms) {
+  struct epoll_event events[4];
+  int n;
+  do {
+    n = epoll_wait(RENDER.epfd, events, ARRAY_SIZEOF(events), timeout_ms);
+  } while (n == -1 && errno == EINTR);
+  uint64_t woke = now_ns();
+  TRACE_SCOPE("dispatch");
+
+  for (int i = 0; i < n; i++) {
+    if (events[i].data.fd == PACE.timerfd && timer_drain(PACE.timerfd))
+      pace_wake();
+    // No callback in a long while, draw anyway.
+    if (events[i].data.fd == RENDER.fallbackfd &&
+        timer_drain(RENDER.fallbackfd)) {
+      RENDER.frame_done = true;
+      PACE.due = true;
+      // Nor is the compositor working through our fifo.
+      RENDER.queued = 0;
+    }
+  }
+
+  eventfd_t count;
+  eventfd_read(RENDER.queue.efd, &count);
+
+  struct render_event ev;
+  while (queue_pop(&RENDER.queue, &ev)) {
+    switch (ev.type) {
+    case EV_RESIZE:
+      WSI.vk.winW = ev.w;
+      WSI.vk.winH = ev.h;
+      WSI.vk.scale = ev.scale;
+      WSI.vk.resizing = ev.resizing;
+      if (ev.ack) {
+        WSI.vk.ackPending = true;
+        WSI.vk.ackSerial = ev.serial;
+      }
+      // The configure is only acked by our next commit, don't wait for a
+      // callback that may never come.
+      RENDER.frame_done = true;
+      PACE.due = true;
+      break;
+    case EV_FRAME:
+      timer_arm(RENDER.fallbackfd, 0, 0);
+      RENDER.lastCallback = now_ns();
+      RENDER.frame_done = true;
+      if (RENDER.queued)
+        RENDER.queued--;
+      if (PACE.enabled)
+        pace_schedule();
+      break;
+    case EV_PRESENTED:
+      pace_presented(&ev);
+      latency_presented(&ev);
+      break;
+    case EV_FEEDBACK: {
+      if (WSI.vk.otherDevice) {
+        free(ev.formats);
+        break;
+      }
+      free(WSI.vk.formats);
+      WSI.vk.formats = ev.formats;
+      WSI.vk.scanout = ev.scanout;
+      // Formats are vulkan's business.
+      if (OPTS.cpu)
+        break;
+      // New modifiers may suit our buffers better, get a new pool.
+      if (WSI.vk.dmabuf) {
+        WSI.vk.recreate = true;
+        break;
+      }
+      // Rebuild if it would now pick another format, which the rebuild then
+      // picks again itself.
+      VkFormat format = WSI.vk.swapFormat;
+      VkColorSpaceKHR space = WSI.vk.swapSpace;
+      surface_format_pick();
+      WSI.vk.recreate |=
+          WSI.vk.swapFormat != format || WSI.vk.swapSpace != space;
+      WSI.vk.swapFormat = format;
+      WSI.vk.swapSpace = space;
+      break;
+    }
+    case EV_RELEASE:
+      if (OPTS.cpu)
+        pool_release(SHM.busy, SHM_BUFFERS, SHM.generation, &SHM.exhausted,
+                     ev.id);
+      else
+        pool_release(DMABUF.busy, WSI.vk.imgCount, DMABUF.generation,
+                     &DMABUF.exhausted, ev.id);
+      break;
+    case EV_CLOSE:
+      RENDER.quit = true;
+      break;
+    }
+  }
+  RENDER.dispatchNs += now_ns() - woke;
+}
+
+// Don't let a hidden window's presents hold the render thread forever.
+#define PRESENT_WAIT_TIMEOUT_NS 100000000ull
+
+// Hold the next frame back until presenting it leaves at most max_queued
+// presents waiting to reach the screen.
+void present_throttle() {
+  if (RENDER.presentId + 1 <= OPTS.max_queued)
+    return;
+  uint64_t waitId = RENDER.presentId + 1 - OPTS.max_queued;
+  // Ids from before a recreate belong to the old swapchain.
+  if (waitId < RENDER.swapFirstId)
+    return;
+
+  VkResult result = VK.vkWaitForPresentKHR(VK.dev, WSI.vk.swapchain, waitId,
+                                           PRESENT_WAIT_TIMEOUT_NS);
+  if (result == VK_TIMEOUT) {
+    RENDER.waitTimeouts++;
+    return;
+  }
+  if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+    WSI.vk.recreate = true;
+    return;
+  }
+
+  // Newer presents may have made it too, count what is really still queued.
+  uint64_t done = waitId;
+  while (done < RENDER.presentId &&
+         VK.vkWaitForPresentKHR(VK.dev, WSI.vk.swapchain, done + 1, 0) ==
+             VK_SUCCESS)
+    done++;
+  uint64_t depth = RENDER.presentId - done;
+  RENDER.depthSum += depth;
+  RENDER.depthMax = MAX(RENDER.depthMax, depth);
+  RENDER.depthSamples++;
 }
 
-static void global_registry_remover(void *data, struct wl_registry *registry,
-                                    uint32_t id) {
-  // This section deliberately left blank.
+void present_wait_stats() {
+  printf("present wait: max %u queued, depth %.2f avg %" PRIu64
+         " max, %" PRIu64 " timeouts\n",
+         OPTS.max_queued,
+         RENDER.depthSamples ? (double)RENDER.depthSum / RENDER.depthSamples
+                             : 0.0,
+         RENDER.depthMax, RENDER.waitTimeouts);
 }
 
-const struct wl_registry_listener registry_listener = {
-    .global = global_registry_handler,
-    .global_remove = global_registry_remover,
-};
+// Headless benchmark
 
-// forward declare for for use in the callback.
-static const struct wl_callback_listener wl_surface_frame_callback_listener;
+void bench_percentiles(const char *name, uint64_t *v, uint32_t n) {
+  if (!n)
+    return;
+  qsort(v, n, sizeof(v[0]), cmp_u64);
+  printf("  %-9s p50 %.3fms  p90 %.3fms  p99 %.3fms  max %.3fms\n", name,
+         percentile(v, n, 50) / 1e6, percentile(v, n, 90) / 1e6,
+         percentile(v, n, 99) / 1e6, v[n - 1] / 1e6);
+}
 
-static void wl_surface_frame_done(void *data, struct wl_callback *cb,
-                                  uint32_t time) {
-  // Mark callback handled.
-  wl_callback_destroy(cb);
+// Labelled with what drew, so --cpu can be compared with a software driver.
+void bench_report(const char *renderer) {
+  double secs = (now_ns() - BENCH.start) / 1e9;
+  printf("headless (%s): %u frames at %ux%u in %.3fs, %.1f frames/s\n",
+         renderer, BENCH.frames, swapSize().width, swapSize().height, secs,
+         BENCH.frames / secs);
+  bench_percentiles("frame", BENCH.interval,
+                    BENCH.frames ? BENCH.frames - 1 : 0);
+  bench_percentiles("cpu", BENCH.cpu, BENCH.frames);
+  bench_percentiles("gpu", BENCH.gpu, BENCH.gpuFrames);
+}
 
-  // Register next frame's callback.
-  cb = wl_surface_frame(WSI.surface);
-  wl_callback_add_listener(cb, &wl_surface_frame_callback_listener, NULL);
-  WSI.frame_done = true;
+// Uncapped modes keep drawing until callbacks stop, as they do when hidden.
+bool render_due() {
+  // Nothing to draw to until the compositor lets go of a buffer.
+  if (WSI.vk.dmabuf && dmabuf_acquire() == -1)
+    return false;
+  if (OPTS.cpu && shm_acquire() == -1)
+    return false;
+  // Keep the compositor's fifo topped up, it does the throttling.
+  if (WSI.fifo)
+    return RENDER.queued < RENDER.frameCount || RENDER.frame_done;
+  if (RENDER.uncapped && now_ns() - RENDER.lastCallback < FRAME_FALLBACK_NS)
+    return true;
+  return PACE.enabled ? PACE.due : RENDER.frame_done;
 }
 
-static const struct wl_callback_listener wl_surface_frame_callback_listener = {
-    .done = wl_surface_frame_done,
-};
+// The GPU the compositor composites with, so our buffers never have to be
+// copied to another one. Matched with VK_EXT_physical_device_drm on its
+// primary or render node, whichever the compositor named. The first device
+// if none match, what feedback says about the compositor's then doesn't
+// apply to us.
+VkPhysicalDevice physical_device_pick(VkPhysicalDevice *devs, uint32_t count) {
+  PFN_vkGetPhysicalDeviceProperties2KHR getProperties2 =
+      (PFN_vkGetPhysicalDeviceProperties2KHR)vkGetInstanceProcAddr(
+          VK.instance, "vkGetPhysicalDeviceProperties2KHR");
+  assert(getProperties2);
+  int64_t devMajor = major(WSI.vk.mainDevice);
+  int64_t devMinor = minor(WSI.vk.mainDevice);
+  bool told = false; // Some device said which node it is.
+  for (uint32_t i = 0; i < count; i++) {
+    uint32_t extCount = ARRAY_SIZEOF(vkDeviceExtensions);
+    vkEnumerateDeviceExtensionProperties(devs[i], NULL, &extCount,
+                                         vkDeviceExtensions);
+    if (!vk_has_extension(vkDeviceExtensions, extCount,
+                          "VK_EXT_physical_device_drm"))
+      continue;
+    VkPhysicalDeviceDrmPropertiesEXT drm = {0};
+    drm.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DRM_PROPERTIES_EXT;
+    VkPhysicalDeviceProperties2 props = {0};
+    props.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    props.pNext = &drm;
+    getProperties2(devs[i], &props);
+    told = true;
+    if ((drm.hasPrimary && drm.primaryMajor == devMajor &&
+         drm.primaryMinor == devMinor) ||
+        (drm.hasRender && drm.renderMajor == devMajor &&
+         drm.renderMinor == devMinor))
+      return devs[i];
+  }
+  if (count > 1)
+    fprintf(stderr, "no vulkan device is the compositor's %d:%d\n",
+            (int)devMajor, (int)devMinor);
+  // Without VK_EXT_physical_device_drm there is no telling, keep trusting
+  // the feedback.
+  if (!told)
+    return devs[0];
+  WSI.vk.otherDevice = true;
+  WSI.vk.scanout = 0;
+  free(WSI.vk.formats);
+  WSI.vk.formats = NULL;
+  return devs[0];
+}
 
-void *render_thread(void *data) { return 0; }
+// Set up everything that goes out with frame id's commit, whether the WSI or
+// we make it.
+void commit_prepare(uint64_t id) {
+  viewport_update();
+
+  // The viewport stretches any buffer to the window, without one the buffer
+  // has to be at its size before the configure is acked.
+  VkExtent2D size = swapSize();
+  if (WSI.vk.ackPending &&
+      (WSI.viewport || (size.width == (uint32_t)WSI.vk.winW &&
+                        size.height == (uint32_t)WSI.vk.winH))) {
+    xdg_surface_ack_configure(WSI.xdg_surface, WSI.vk.ackSerial);
+    WSI.vk.ackPending = false;
+  }
 
-VkResult recreate_swapchain() {
-  for (uint32_t i = 0; i < WSI.vk.imgCount; i++) {
-    vkDestroyFramebuffer(VK.dev, WSI.vk.fb[i], NULL);
-    WSI.vk.fb[i] = NULL;
-    vkDestroyImageView(VK.dev, WSI.vk.swapImgView[i], NULL);
-    WSI.vk.swapImgView[i] = NULL;
+  // The commit gets its own frame callback, nothing is drawn until it fires
+  // or the fallback timer gives up on it.
+  struct wl_callback *cb = wl_surface_frame(WSI.surface);
+  wl_callback_add_listener(cb, &wl_surface_frame_callback_listener, NULL);
+  timer_arm(RENDER.fallbackfd, now_ns() + FRAME_FALLBACK_NS, 0);
+
+  // Ask when the commit reaches the screen.
+  if (WSI.presentation) {
+    struct wp_presentation_feedback *feedback =
+        wp_presentation_feedback(WSI.presentation, WSI.surface);
+    wp_presentation_feedback_add_listener(feedback, &feedback_listener,
+                                          (void *)(uintptr_t)id);
   }
-  vkDestroySwapchainKHR(VK.dev, WSI.vk.swapchain, NULL);
-  WSI.vk.swapchain = NULL;
 
-  // TODO: validate our format/colorspace/presentmode
-  WSI.vk.swapFormat = VK_FORMAT_B8G8R8A8_SRGB;
-  WSI.vk.swapSpace = VK_COLOR_SPACE_SRGB_NONLINEAR_KHR;
+  // Rather than the driver blocking until the vblank, the compositor holds
+  // the commit until the previous one has been on screen for a refresh and
+  // its target time has come.
+  if (WSI.fifo) {
+    wp_fifo_v1_wait_barrier(WSI.fifo);
+    wp_fifo_v1_set_barrier(WSI.fifo);
+    RENDER.queued++;
+  }
+  if (WSI.commitTimer && PACE.target && !RENDER.timestampPending) {
+    uint64_t t = clock_convert(PACE.target, CLOCK_MONOTONIC, WSI.presentClock);
+    uint64_t sec = t / 1000000000ull;
+    wp_commit_timer_v1_set_timestamp(WSI.commitTimer, sec >> 32,
+                                     sec & 0xffffffff, t % 1000000000ull);
+    RENDER.timestampPending = true;
+  }
+}
 
-  VkSwapchainCreateInfoKHR createSwapInfo = {0};
-  createSwapInfo.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
-  createSwapInfo.surface = WSI.vk.surface;
-  createSwapInfo.minImageCount = 4;
-  createSwapInfo.imageFormat = WSI.vk.swapFormat;
-  createSwapInfo.imageColorSpace = WSI.vk.swapSpace;
-  createSwapInfo.imageExtent = swapSize();
-  createSwapInfo.imageArrayLayers = 1;
-  createSwapInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
-  createSwapInfo.preTransform = WSI.vk.surfCaps.currentTransform;
-  createSwapInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
-  createSwapInfo.presentMode = VK_PRESENT_MODE_FIFO_KHR;
-  createSwapInfo.clipped = VK_TRUE;
-  // Only same queue gfx/present.
-  createSwapInfo.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
+// Where the triangle is frame frames in. Scaled up to be the same size on a
+// subsurface smaller than the window.
+struct MData spin_matrix(float frame) {
+  float theta = frame * 3.1415f / 200.f;
+  float zoom = WSI.subsurface ? 1 / CONTENT_SHARE : 1;
+  float c = cosf(theta) * zoom, sn = sinf(theta) * zoom;
+  struct MData spin = {
+      // clang-format off
+      c, -sn, 0.f, 0.f,
+      sn, c, 0.f, 0.f,
+      0.f, 0.f, 1.f, 0.f,
+      0.f, 0.f, 0.f, 1.f,
+      // clang-format on
+  };
+  return spin;
+}
 
-  VkResult result =
-      vkCreateSwapchainKHR(VK.dev, &createSwapInfo, NULL, &WSI.vk.swapchain);
-  assert(result == VK_SUCCESS);
+// render_thread without a GPU: the same triangle rasterized into wl_shm
+// buffers, or into memory when headless for a benchmark against vulkan.
+// Paced the same, the commits are ours as with --dmabuf.
+void *cpu_thread(bool headless) {
+  raster_init();
+  caps_fake((VkExtent2D){RASTER_MAX_EXTENT, RASTER_MAX_EXTENT});
+  if (OPTS.dynamic_res)
+    fprintf(stderr, "no dynamic resolution with --cpu\n");
+
+  uint32_t *target = NULL;
+  if (headless) {
+    VkExtent2D size = swapSize();
+    target = calloc((size_t)size.width * size.height, sizeof(*target));
+    assert(target);
+    BENCH.interval = calloc(OPTS.headless_frames, sizeof(uint64_t));
+    BENCH.cpu = calloc(OPTS.headless_frames, sizeof(uint64_t));
+    BENCH.start = now_ns();
+  } else {
+    // Every compositor has it, it is how cursors get drawn.
+    assert(WSI.shm);
+    resize_update();
+    WSI.vk.recreate = false;
+    shm_create();
+    opaque_region_set(WSI.surface);
+  }
 
-  WSI.vk.imgCount = 8;
-  vkGetSwapchainImagesKHR(VK.dev, WSI.vk.swapchain, &WSI.vk.imgCount,
-                          &WSI.vk.swapImg[0]);
+  RENDER.frame_done = true;
+  PACE.enabled = WSI.presentation && !OPTS.no_pace && !WSI.fifo;
+  RENDER.lastCallback = now_ns();
+  PACE.due = true;
+  float frame = 0;
+  uint64_t id = 0;
+  while (!RENDER.quit) {
+    if (headless) {
+      if (BENCH.frames == OPTS.headless_frames)
+        break;
+    } else {
+      render_poll(render_due() ? 0 : -1);
+      if (RENDER.quit)
+        break;
+      if (!render_due())
+        continue;
+    }
 
-  for (uint32_t i = 0; i < WSI.vk.imgCount; i++) {
-    VkImageViewCreateInfo createViewInfo = {0};
-    createViewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-    createViewInfo.image = WSI.vk.swapImg[i];
-    createViewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
-    createViewInfo.format = WSI.vk.swapFormat;
-    createViewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    createViewInfo.subresourceRange.baseMipLevel = 0;
-    createViewInfo.subresourceRange.levelCount = 1;
-    createViewInfo.subresourceRange.baseArrayLayer = 0;
-    createViewInfo.subresourceRange.layerCount = 1;
-    result = vkCreateImageView(VK.dev, &createViewInfo, NULL,
-                               &WSI.vk.swapImgView[i]);
-    assert(result == VK_SUCCESS);
+    uint64_t frameStart = now_ns();
+    uint64_t stages[STAGE_COUNT] = {RENDER.dispatchNs};
+    uint64_t lap = frameStart;
+    frame += 1;
+    atomic_fetch_add(&RENDER.drawn, 1);
+
+    uint32_t *pixels = target;
+    int32_t w = swapSize().width, h = swapSize().height;
+    int32_t index = 0;
+    if (!headless) {
+      resize_update();
+      if (WSI.vk.recreate) {
+        WSI.vk.recreate = false;
+        shm_create();
+      }
+      // render_due() made sure one is free.
+      index = shm_acquire();
+      pixels = SHM.buf[index].pixels;
+      w = SHM.w;
+      h = SHM.h;
+      latency_consume(id);
+      RENDER.frame_done = false;
+      PACE.due = false;
+      if (WSI.fifo)
+        PACE.target = pace_next_vblank(frameStart + pace_budget());
+      PACE.lastTarget = PACE.target;
+      PACE.targets[id % PACE_TARGETS] =
+          PACE.enabled || WSI.fifo ? PACE.target : 0;
+    }
+    stages[STAGE_ACQUIRE] = stage_lap(&lap);
+
+    struct MData spin = spin_matrix(frame);
+    raster_draw(pixels, w, h, &spin, atomic_load(&RENDER.pressed));
+    stages[STAGE_RECORD] = stage_lap(&lap);
+    RENDER.dispatchNs = 0;
+
+    if (headless) {
+      stage_push(frameStart, stages);
+      TRACE_FRAME(id, frameStart, stages);
+      uint64_t now = now_ns();
+      if (BENCH.frames)
+        BENCH.interval[BENCH.frames - 1] = now - BENCH.lastSubmit;
+      BENCH.cpu[BENCH.frames++] = now - frameStart;
+      BENCH.lastSubmit = now;
+      id++;
+      continue;
+    }
+
+    // Every pixel was rewritten.
+    commit_prepare(id);
+    wl_surface_attach(WSI.surface, SHM.buf[index].buffer, 0, 0);
+    wl_surface_damage_buffer(WSI.surface, 0, 0, INT32_MAX, INT32_MAX);
+    wl_surface_commit(WSI.surface);
+    wl_display_flush(WSI.display);
+    SHM.busy[index] = true;
+    RENDER.timestampPending = false;
+    stages[STAGE_PRESENT] = stage_lap(&lap);
+    stage_push(frameStart, stages);
+    TRACE_FRAME(id, frameStart, stages);
+    cost_push(&PACE.cpu, lap - frameStart);
+    id++;
   }
+  raster_finish();
 
-  return result;
+  if (headless) {
+    char renderer[32];
+    snprintf(renderer, sizeof(renderer), "cpu, %u threads",
+             RASTER.threadCount + 1);
+    bench_report(renderer);
+  }
+  if (headless && OPTS.stage_stats)
+    stage_report();
+  if (WSI.presentation)
+    pace_stats();
+  if (WSI.presentation && atomic_load(&RENDER.inputSeq))
+    latency_report();
+  if (!headless)
+    shm_stats();
+  return NULL;
 }
 
-int main(int argc, char *argv[]) {
-  WSI.display = wl_display_connect(NULL);
-  assert(WSI.display);
-  struct wl_registry *registry = wl_display_get_registry(WSI.display);
-  wl_registry_add_listener(registry, &registry_listener, NULL);
-  wl_display_roundtrip(WSI.display);
-
-  // Create our surface and add xdg_shell roles so it will be displayed.
-  WSI.w = 300;
-  WSI.h = 300;
-  WSI.xdg_surface = xdg_wm_base_get_xdg_surface(WSI.wm, WSI.surface);
-  xdg_surface_add_listener(WSI.xdg_surface, &xdg_surface_listener, NULL);
-  WSI.xdg_toplevel = xdg_surface_get_toplevel(WSI.xdg_surface);
-  xdg_toplevel_add_listener(WSI.xdg_toplevel, &xdg_toplevel_listener, NULL);
-  xdg_toplevel_set_title(WSI.xdg_toplevel, "Wayland VK window");
-
-  struct wl_callback *cb = wl_surface_frame(WSI.surface);
-  wl_callback_add_listener(cb, &wl_surface_frame_callback_listener, NULL);
+// Owns the vulkan device and does all recording and submission so a slow
+// present or fence wait never holds up the wayland thread.
+void *render_thread(void *arg) {
+  bool headless = OPTS.backend == BACKEND_HEADLESS;
+  RENDER.frameCount = OPTS.frames_in_flight;
+  TRACE_THREAD(TRACK_RENDER);
+  if (OPTS.cpu)
+    return cpu_thread(headless);
+  WSI.vk.dmabuf = OPTS.backend == BACKEND_DMABUF;
 
   // Test vulkan works
   uint32_t extensionCount = 64;
@@ -317,16 +3833,37 @@ int main(int argc, char *argv[]) {
   appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
   appInfo.pApplicationName = "Vulkan Wayland Demo";
   appInfo.applicationVersion = VK_MAKE_VERSION(0, 0, 1);
-  appInfo.apiVersion =
-      VK_API_VERSION_1_0; // Vulkan 1.0 drivers will refuse other versions.
+  // Vulkan 1.0 drivers will refuse other versions, --dmabuf needs 1.1 for
+  // external memory and semaphores if the loader has it.
+  appInfo.apiVersion = VK_API_VERSION_1_0;
+  PFN_vkEnumerateInstanceVersion enumerateVersion =
+      (PFN_vkEnumerateInstanceVersion)vkGetInstanceProcAddr(
+          NULL, "vkEnumerateInstanceVersion");
+  uint32_t instanceVersion = VK_API_VERSION_1_0;
+  if (enumerateVersion)
+    enumerateVersion(&instanceVersion);
+  if (WSI.vk.dmabuf && instanceVersion >= VK_API_VERSION_1_1)
+    appInfo.apiVersion = VK_API_VERSION_1_1;
 
   // MoltenVK requires VK_KHR_portability_enumeration for nonconformance.
-  const char *waylandExts[2] = {"VK_KHR_wayland_surface", "VK_KHR_surface"};
+  const char *waylandExts[4] = {"VK_KHR_wayland_surface", "VK_KHR_surface"};
+  uint32_t waylandExtCount = headless ? 0 : 2;
+  // Needed to query the present id/wait features and which DRM device a
+  // physical device is on vulkan 1.0.
+  bool props2 = vk_has_extension(vkExtensions, extensionCount,
+                                 "VK_KHR_get_physical_device_properties2");
+  if (!headless && props2)
+    waylandExts[waylandExtCount++] = "VK_KHR_get_physical_device_properties2";
+  // fp16 surfaces come in the extended linear sRGB colour space.
+  if (!headless && OPTS.surface_depth == DEPTH_16F &&
+      vk_has_extension(vkExtensions, extensionCount,
+                       "VK_EXT_swapchain_colorspace"))
+    waylandExts[waylandExtCount++] = "VK_EXT_swapchain_colorspace";
   const char *validationLayers[1] = {"VK_LAYER_KHRONOS_validation"};
   VkInstanceCreateInfo createInstInfo = {0};
   createInstInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
   createInstInfo.pApplicationInfo = &appInfo;
-  createInstInfo.enabledExtensionCount = ARRAY_SIZEOF(waylandExts);
+  createInstInfo.enabledExtensionCount = waylandExtCount;
   createInstInfo.ppEnabledExtensionNames = waylandExts;
 #ifdef VK_VALIDATION
   createInstInfo.enabledLayerCount = ARRAY_SIZEOF(validationLayers);
@@ -334,13 +3871,29 @@ int main(int argc, char *argv[]) {
 #endif
 
   VkResult result = vkCreateInstance(&createInstInfo, NULL, &VK.instance);
-  assert(!result);
-
-  uint32_t deviceCount = 8;
+  if (result != VK_SUCCESS && result != VK_ERROR_INCOMPATIBLE_DRIVER)
+    fprintf(stderr, "vkCreateInstance failed: %d\n", result);
+  assert(result == VK_SUCCESS || result == VK_ERROR_INCOMPATIBLE_DRIVER);
+  uint32_t deviceCount = 0;
   VkPhysicalDevice pDevices[8];
-  vkEnumeratePhysicalDevices(VK.instance, &deviceCount, pDevices);
-  assert(deviceCount >= 1);
+  if (result == VK_SUCCESS) {
+    deviceCount = ARRAY_SIZEOF(pDevices);
+    vkEnumeratePhysicalDevices(VK.instance, &deviceCount, pDevices);
+    if (!deviceCount) {
+      vkDestroyInstance(VK.instance, NULL);
+      VK.instance = VK_NULL_HANDLE;
+    }
+  }
+  // No driver to draw with, do it ourselves.
+  if (!deviceCount) {
+    fprintf(stderr, "no vulkan device, drawing on the CPU\n");
+    OPTS.cpu = true;
+    WSI.vk.dmabuf = false;
+    return cpu_thread(headless);
+  }
   VK.pdev = pDevices[0];
+  if (!headless && props2 && WSI.vk.mainDevice)
+    VK.pdev = physical_device_pick(pDevices, deviceCount);
 
   // If physical device info is needed.
   VkPhysicalDeviceProperties deviceProperties;
@@ -348,15 +3901,43 @@ int main(int argc, char *argv[]) {
   VkPhysicalDeviceFeatures deviceFeatures;
   vkGetPhysicalDeviceFeatures(VK.pdev, &deviceFeatures);
   vkGetPhysicalDeviceMemoryProperties(VK.pdev, &VK.pmem);
+  uint32_t deviceExtensionCount = ARRAY_SIZEOF(vkDeviceExtensions);
+  vkEnumerateDeviceExtensionProperties(VK.pdev, NULL, &deviceExtensionCount,
+                                       vkDeviceExtensions);
+
+  // Our own buffers need the device to export them in a modifier the
+  // compositor imports, as listed in the feedback already queued for us.
+  if (WSI.vk.dmabuf) {
+    bool supported = appInfo.apiVersion >= VK_API_VERSION_1_1 &&
+                     deviceProperties.apiVersion >= VK_API_VERSION_1_1;
+    for (uint32_t i = 0; i < ARRAY_SIZEOF(dmabufExtensions); i++)
+      supported &= vk_has_extension(vkDeviceExtensions, deviceExtensionCount,
+                                    dmabufExtensions[i]);
+    if (supported) {
+      VK.vkGetPhysicalDeviceFormatProperties2 =
+          (PFN_vkGetPhysicalDeviceFormatProperties2KHR)vkGetInstanceProcAddr(
+              VK.instance, "vkGetPhysicalDeviceFormatProperties2");
+      render_poll(0);
+      supported = dmabuf_format_pick() != -1;
+    }
+    if (!supported) {
+      fprintf(stderr, "can't share buffers with the compositor, using the "
+                      "swapchain\n");
+      WSI.vk.dmabuf = false;
+    }
+  }
+  bool swapchain = !headless && !WSI.vk.dmabuf;
 
   // Setup the WSI surface so we can check it against queues.
-  VkWaylandSurfaceCreateInfoKHR surfCreateInfo = {0};
-  surfCreateInfo.sType = VK_STRUCTURE_TYPE_WAYLAND_SURFACE_CREATE_INFO_KHR;
-  surfCreateInfo.display = WSI.display;
-  surfCreateInfo.surface = WSI.surface;
-  result = vkCreateWaylandSurfaceKHR(VK.instance, &surfCreateInfo, NULL,
-                                     &WSI.vk.surface);
-  assert(result == VK_SUCCESS);
+  if (swapchain) {
+    VkWaylandSurfaceCreateInfoKHR surfCreateInfo = {0};
+    surfCreateInfo.sType = VK_STRUCTURE_TYPE_WAYLAND_SURFACE_CREATE_INFO_KHR;
+    surfCreateInfo.display = WSI.display;
+    surfCreateInfo.surface = WSI.surface;
+    result = vkCreateWaylandSurfaceKHR(VK.instance, &surfCreateInfo, NULL,
+                                       &WSI.vk.surface);
+    assert(result == VK_SUCCESS);
+  }
 
   // Find graphics queue
   uint32_t queueFamilyCount = 8;
@@ -365,9 +3946,10 @@ int main(int argc, char *argv[]) {
                                            queueFamilies);
   VK.gfxIdx = -1;
   for (uint32_t i = 0; i < queueFamilyCount; i++) {
-    VkBool32 presentSupport = false;
-    vkGetPhysicalDeviceSurfaceSupportKHR(VK.pdev, i, WSI.vk.surface,
-                                         &presentSupport);
+    VkBool32 presentSupport = !swapchain;
+    if (swapchain)
+      vkGetPhysicalDeviceSurfaceSupportKHR(VK.pdev, i, WSI.vk.surface,
+                                           &presentSupport);
     if (queueFamilies[i].queueFlags & VK_QUEUE_GRAPHICS_BIT && presentSupport &&
         VK.gfxIdx == -1) {
       VK.gfxIdx = i;
@@ -384,7 +3966,95 @@ int main(int argc, char *argv[]) {
 
   VkPhysicalDeviceFeatures enabledDeviceFeatures = {0};
 
-  const char *deviceExts[1] = {"VK_KHR_swapchain"};
+  const char *deviceExts[16] = {"VK_KHR_swapchain"};
+  uint32_t deviceExtCount = swapchain ? 1 : 0;
+  if (WSI.vk.dmabuf) {
+    for (uint32_t i = 0; i < ARRAY_SIZEOF(dmabufExtensions); i++)
+      deviceExts[deviceExtCount++] = dmabufExtensions[i];
+  }
+
+  // Tells vk_memory_alloc which resources want memory of their own.
+  bool core11 = appInfo.apiVersion >= VK_API_VERSION_1_1 &&
+                deviceProperties.apiVersion >= VK_API_VERSION_1_1;
+  bool dedicated = core11;
+  if (!core11 &&
+      vk_has_extension(vkDeviceExtensions, deviceExtensionCount,
+                       "VK_KHR_get_memory_requirements2") &&
+      vk_has_extension(vkDeviceExtensions, deviceExtensionCount,
+                       "VK_KHR_dedicated_allocation")) {
+    deviceExts[deviceExtCount++] = "VK_KHR_get_memory_requirements2";
+    deviceExts[deviceExtCount++] = "VK_KHR_dedicated_allocation";
+    dedicated = true;
+  }
+
+  // Present ids tag every present so we can wait for it to reach the screen.
+  VkPhysicalDevicePresentWaitFeaturesKHR presentWaitFeatures = {0};
+  presentWaitFeatures.sType =
+      VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR;
+  VkPhysicalDevicePresentIdFeaturesKHR presentIdFeatures = {0};
+  presentIdFeatures.sType =
+      VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR;
+  presentIdFeatures.pNext = &presentWaitFeatures;
+  bool presentWait = false;
+  if (OPTS.max_queued && swapchain && props2 &&
+      vk_has_extension(vkDeviceExtensions, deviceExtensionCount,
+                       "VK_KHR_present_id") &&
+      vk_has_extension(vkDeviceExtensions, deviceExtensionCount,
+                       "VK_KHR_present_wait")) {
+    PFN_vkGetPhysicalDeviceFeatures2KHR getFeatures2 =
+        (PFN_vkGetPhysicalDeviceFeatures2KHR)vkGetInstanceProcAddr(
+            VK.instance, "vkGetPhysicalDeviceFeatures2KHR");
+    VkPhysicalDeviceFeatures2 features2 = {0};
+    features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features2.pNext = &presentIdFeatures;
+    getFeatures2(VK.pdev, &features2);
+    presentWait =
+        presentIdFeatures.presentId && presentWaitFeatures.presentWait;
+  }
+  if (presentWait) {
+    deviceExts[deviceExtCount++] = "VK_KHR_present_id";
+    deviceExts[deviceExtCount++] = "VK_KHR_present_wait";
+  } else if (OPTS.max_queued && WSI.vk.dmabuf) {
+    fprintf(stderr,
+            "--dmabuf queues at most its buffers, ignoring --max-queued\n");
+  } else if (OPTS.max_queued) {
+    fprintf(stderr, "VK_KHR_present_wait unsupported, ignoring --max-queued\n");
+  }
+
+  // Passes our damage on to the compositor instead of the whole surface. Our
+  // own buffers damage it themselves.
+  DAMAGE.incremental = WSI.vk.dmabuf && !OPTS.no_damage;
+  if (swapchain && !OPTS.no_damage &&
+      vk_has_extension(vkDeviceExtensions, deviceExtensionCount,
+                       "VK_KHR_incremental_present")) {
+    deviceExts[deviceExtCount++] = "VK_KHR_incremental_present";
+    DAMAGE.incremental = true;
+  }
+
+#ifdef TRACE
+  // Puts GPU timestamps on CLOCK_MONOTONIC, if the device can sample both.
+  bool calibrated = false;
+  if (vk_has_extension(vkDeviceExtensions, deviceExtensionCount,
+                       "VK_EXT_calibrated_timestamps")) {
+    PFN_vkGetPhysicalDeviceCalibrateableTimeDomainsEXT getDomains =
+        (PFN_vkGetPhysicalDeviceCalibrateableTimeDomainsEXT)
+            vkGetInstanceProcAddr(
+                VK.instance, "vkGetPhysicalDeviceCalibrateableTimeDomainsEXT");
+    uint32_t domainCount = 8;
+    VkTimeDomainEXT domains[8];
+    bool device = false, monotonic = false;
+    if (getDomains && getDomains(VK.pdev, &domainCount, domains) >= 0) {
+      for (uint32_t i = 0; i < domainCount; i++) {
+        device |= domains[i] == VK_TIME_DOMAIN_DEVICE_EXT;
+        monotonic |= domains[i] == VK_TIME_DOMAIN_CLOCK_MONOTONIC_EXT;
+      }
+    }
+    calibrated = device && monotonic;
+  }
+  if (calibrated)
+    deviceExts[deviceExtCount++] = "VK_EXT_calibrated_timestamps";
+#endif
+
   VkDeviceCreateInfo createDevInfo = {0};
   createDevInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
   createDevInfo.pQueueCreateInfos = &queueCreateInfo;
@@ -396,35 +4066,66 @@ int main(int argc, char *argv[]) {
   createDevInfo.enabledLayerCount = ARRAY_SIZEOF(validationLayers);
   createDevInfo.ppEnabledLayerNames = validationLayers;
 #endif
-  createDevInfo.enabledExtensionCount = ARRAY_SIZEOF(deviceExts);
+  createDevInfo.enabledExtensionCount = deviceExtCount;
   createDevInfo.ppEnabledExtensionNames = deviceExts;
+  // The queried features are exactly the ones to enable.
+  if (presentWait)
+    createDevInfo.pNext = &presentIdFeatures;
 
   result = vkCreateDevice(VK.pdev, &createDevInfo, NULL, &VK.dev);
   assert(result == VK_SUCCESS);
   vkGetDeviceQueue(VK.dev, VK.gfxIdx, 0, &VK.gfx);
   assert(VK.gfx != NULL);
+  if (presentWait) {
+    VK.vkWaitForPresentKHR = (PFN_vkWaitForPresentKHR)vkGetDeviceProcAddr(
+        VK.dev, "vkWaitForPresentKHR");
+    assert(VK.vkWaitForPresentKHR);
+  }
+  if (WSI.vk.dmabuf) {
+    VK.vkGetImageDrmFormatModifierPropertiesEXT =
+        (PFN_vkGetImageDrmFormatModifierPropertiesEXT)vkGetDeviceProcAddr(
+            VK.dev, "vkGetImageDrmFormatModifierPropertiesEXT");
+    VK.vkGetMemoryFdKHR = (PFN_vkGetMemoryFdKHR)vkGetDeviceProcAddr(
+        VK.dev, "vkGetMemoryFdKHR");
+    VK.vkGetSemaphoreFdKHR = (PFN_vkGetSemaphoreFdKHR)vkGetDeviceProcAddr(
+        VK.dev, "vkGetSemaphoreFdKHR");
+    VK.vkImportSemaphoreFdKHR = (PFN_vkImportSemaphoreFdKHR)vkGetDeviceProcAddr(
+        VK.dev, "vkImportSemaphoreFdKHR");
+    assert(VK.vkGetImageDrmFormatModifierPropertiesEXT &&
+           VK.vkGetMemoryFdKHR && VK.vkGetSemaphoreFdKHR &&
+           VK.vkImportSemaphoreFdKHR);
+  }
+  if (dedicated) {
+    VK.vkGetBufferMemoryRequirements2 =
+        (PFN_vkGetBufferMemoryRequirements2KHR)vkGetDeviceProcAddr(
+            VK.dev, core11 ? "vkGetBufferMemoryRequirements2"
+                           : "vkGetBufferMemoryRequirements2KHR");
+    VK.vkGetImageMemoryRequirements2 =
+        (PFN_vkGetImageMemoryRequirements2KHR)vkGetDeviceProcAddr(
+            VK.dev, core11 ? "vkGetImageMemoryRequirements2"
+                           : "vkGetImageMemoryRequirements2KHR");
+    assert(VK.vkGetBufferMemoryRequirements2 &&
+           VK.vkGetImageMemoryRequirements2);
+  }
+#ifdef TRACE
+  if (calibrated)
+    TRACER.vkGetCalibratedTimestampsEXT =
+        (PFN_vkGetCalibratedTimestampsEXT)vkGetDeviceProcAddr(
+            VK.dev, "vkGetCalibratedTimestampsEXT");
+  TRACER.period = deviceProperties.limits.timestampPeriod;
+#endif
 
-  uint32_t swapFormatsCount = 128;
-  VkSurfaceFormatKHR swapFormats[128] = {0};
-  vkGetPhysicalDeviceSurfaceFormatsKHR(VK.pdev, WSI.vk.surface,
-                                       &swapFormatsCount, swapFormats);
-  vkGetPhysicalDeviceSurfaceCapabilitiesKHR(VK.pdev, WSI.vk.surface,
-                                            &WSI.vk.surfCaps);
-  uint32_t presentModeCount = 8;
-  VkPresentModeKHR presentModes[8] = {0};
-  vkGetPhysicalDeviceSurfacePresentModesKHR(VK.pdev, WSI.vk.surface,
-                                            &presentModeCount, presentModes);
-  assert(presentModeCount > 0);
-  assert(swapFormatsCount > 0);
-
-  // Get our top level configured for our swapchain.
-  wl_surface_set_buffer_scale(WSI.surface, 1);
-  wl_surface_commit(WSI.surface);
-  wl_display_dispatch(WSI.display);
-  wl_display_roundtrip(WSI.display);
-
-  // TODO: validate our format/colorspace/presentmode
-  recreate_swapchain();
+  if (headless) {
+    offscreen_create();
+  } else {
+    // Start out at the device pixel size rather than rebuilding on frame 0.
+    resize_update();
+    WSI.vk.recreate = false;
+    if (WSI.vk.dmabuf)
+      dmabuf_init(deviceProperties.limits.maxImageDimension2D);
+    else
+      swapchain_init();
+  }
 
   // Now we can build some shaders and pipelines.
 
@@ -448,32 +4149,37 @@ int main(int argc, char *argv[]) {
   assert(result == VK_SUCCESS);
 
   // Pools for all the descriptors we can bind into our layout(s).
-  // Assuming only 1 frame in flight, more needed for more frames.
+  // One set per frame in flight so each can point at its own matrix.
   VkDescriptorPoolSize poolSize = {0};
   poolSize.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-  poolSize.descriptorCount = 1;
+  poolSize.descriptorCount = RENDER.frameCount;
 
   VkDescriptorPoolCreateInfo descPoolInfo = {0};
   descPoolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
   descPoolInfo.poolSizeCount = 1;
   descPoolInfo.pPoolSizes = &poolSize;
   // how many DescriptorSets we can allocate out of this pool.
-  descPoolInfo.maxSets = 1;
+  descPoolInfo.maxSets = RENDER.frameCount;
 
   VkDescriptorPool descriptorPool;
   result = vkCreateDescriptorPool(VK.dev, &descPoolInfo, NULL, &descriptorPool);
   assert(result == VK_SUCCESS);
 
-  // Finally allocate the set from the pool for our layout.
+  // Finally allocate the sets from the pool for our layout.
+  VkDescriptorSetLayout setLayouts[MAX_FRAMES_IN_FLIGHT];
+  for (uint32_t i = 0; i < RENDER.frameCount; i++)
+    setLayouts[i] = descriptorSetLayout;
   VkDescriptorSetAllocateInfo descSetAllocInfo = {0};
   descSetAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
   descSetAllocInfo.descriptorPool = descriptorPool;
-  descSetAllocInfo.descriptorSetCount = 1;
-  descSetAllocInfo.pSetLayouts = &descriptorSetLayout;
+  descSetAllocInfo.descriptorSetCount = RENDER.frameCount;
+  descSetAllocInfo.pSetLayouts = setLayouts;
 
-  VkDescriptorSet descSet;
-  result = vkAllocateDescriptorSets(VK.dev, &descSetAllocInfo, &descSet);
+  VkDescriptorSet descSets[MAX_FRAMES_IN_FLIGHT];
+  result = vkAllocateDescriptorSets(VK.dev, &descSetAllocInfo, descSets);
   assert(result == VK_SUCCESS);
+  for (uint32_t i = 0; i < RENDER.frameCount; i++)
+    RENDER.frame[i].descSet = descSets[i];
 
   // Alright actual shader stuff now.
   VkShaderModule fragShader, vertShader;
@@ -499,6 +4205,12 @@ int main(int argc, char *argv[]) {
   shaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
   shaderStages[1].module = fragShader;
   shaderStages[1].pName = "main";
+  // Its encodeSrgb, for formats that don't encode.
+  VkBool32 encodeSrgb = format_encodes();
+  VkSpecializationMapEntry encodeEntry = {0, 0, sizeof(encodeSrgb)};
+  VkSpecializationInfo fragSpec = {1, &encodeEntry, sizeof(encodeSrgb),
+                                   &encodeSrgb};
+  shaderStages[1].pSpecializationInfo = &fragSpec;
 
   // Avoid setting VkPipelineViewportStateCreateInfo
   VkDynamicState dynamicStates[2] = {VK_DYNAMIC_STATE_VIEWPORT,
@@ -508,27 +4220,6 @@ int main(int argc, char *argv[]) {
   dynamicState.dynamicStateCount = ARRAY_SIZEOF(dynamicStates);
   dynamicState.pDynamicStates = dynamicStates;
 
-  // Representation of the packed vertex stage input for use in configuring
-  // shader input. Also VUID-VkVertexInputBindingDescription-stride-04456
-  struct VData {
-    struct {
-      float p1;
-      float p2;
-    } pos;
-    struct {
-      float c1;
-      float c2;
-      float c3;
-    } col;
-  };
-  struct VData vertexIn[3] = {
-      {{0.0f, -0.5f}, {1.0f, 0.0f, 0.0f}},
-      {{0.5f, 0.5f}, {0.0f, 1.0f, 0.0f}},
-      {{-0.5f, 0.5f}, {0.0f, 0.0f, 1.0f}},
-  };
-  struct MData {
-    float m[16];
-  };
   struct MData matrixIn = {
       // clang-format off
       1.f, 0.f, 0.f, 0.f,
@@ -619,49 +4310,22 @@ int main(int argc, char *argv[]) {
                                   &pipelineLayout);
   assert(result == VK_SUCCESS);
 
-  // Render Pass info
-  VkAttachmentDescription colorAttachment = {0};
-  // Needs a recreate if swapchain format changes...
-  colorAttachment.format = WSI.vk.swapFormat;
-  colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
-  colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-  colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-  colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-  colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-  colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-  colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
-
-  VkAttachmentReference colorAttachmentRef = {0};
-  colorAttachmentRef.attachment = 0; // location = 0 output.
-  colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-
-  VkSubpassDescription subpass = {0};
-  subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-  subpass.colorAttachmentCount = 1;
-  subpass.pColorAttachments = &colorAttachmentRef;
-
-  VkSubpassDependency dependency = {0};
-  // subpass 0 color attachment has a write dependency against ...
-  dependency.dstSubpass = 0;
-  dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-  dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-  // swapchain's external access of color attachments.
-  dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-  dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-  dependency.srcAccessMask = 0;
-
-  VkRenderPassCreateInfo renderPassInfo = {0};
-  renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-  renderPassInfo.attachmentCount = 1;
-  renderPassInfo.pAttachments = &colorAttachment;
-  renderPassInfo.subpassCount = 1;
-  renderPassInfo.pSubpasses = &subpass;
-  renderPassInfo.dependencyCount = 1;
-  renderPassInfo.pDependencies = &dependency;
-
-  VkRenderPass renderPass;
-  vkCreateRenderPass(VK.dev, &renderPassInfo, NULL, &renderPass);
-  assert(result == VK_SUCCESS);
+  // Offscreen images are left ready to be read back instead of presented, our
+  // own buffers in the one layout the compositor's driver knows.
+  VkImageLayout presentLayout =
+      headless        ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL
+      : WSI.vk.dmabuf ? VK_IMAGE_LAYOUT_GENERAL
+                      : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+  VkRenderPass renderPass = render_pass_new(
+      WSI.vk.swapFormat, VK_IMAGE_LAYOUT_UNDEFINED, presentLayout);
+  // Same format so the pipeline works with all of them. This one ends ready
+  // for the dynamic resolution blit, the damage one redraws part of an image
+  // we presented before.
+  VkRenderPass sceneRenderPass =
+      render_pass_new(WSI.vk.swapFormat, VK_IMAGE_LAYOUT_UNDEFINED,
+                      VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+  VkRenderPass damageRenderPass =
+      render_pass_new(WSI.vk.swapFormat, presentLayout, presentLayout);
 
   // Finally assemble the pipeline
   VkGraphicsPipelineCreateInfo pipelineInfo = {0};
@@ -680,6 +4344,7 @@ int main(int argc, char *argv[]) {
   pipelineInfo.renderPass = renderPass;
   pipelineInfo.subpass = 0;
 
+  VkFormat renderFormat = WSI.vk.swapFormat;
   VkPipeline graphicsPipeline;
   result = vkCreateGraphicsPipelines(VK.dev, VK_NULL_HANDLE, 1, &pipelineInfo,
                                      NULL, &graphicsPipeline);
@@ -691,57 +4356,50 @@ int main(int argc, char *argv[]) {
                     VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
                         VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
 
-  void *data;
-  vkMapMemory(VK.dev, vertexBuffer.mem, 0, vertexBuffer.ci.size, 0, &data);
-  memcpy(data, vertexIn, (size_t)vertexBuffer.ci.size);
-  vkUnmapMemory(VK.dev, vertexBuffer.mem);
+  memcpy(vertexBuffer.alloc.mapped, vertexIn, (size_t)vertexBuffer.ci.size);
 
-  struct vk_buffer matrixBuffer =
-      vk_buffer_new(sizeof(struct MData), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-                    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-                        VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-  vkMapMemory(VK.dev, matrixBuffer.mem, 0, matrixBuffer.ci.size, 0, &data);
-  memcpy(data, &matrixIn, (size_t)matrixBuffer.ci.size);
+  // One matrix slice per frame in flight, each aligned for use as a UBO.
+  VkDeviceSize align = deviceProperties.limits.minUniformBufferOffsetAlignment;
+  VkDeviceSize matrixStride =
+      (sizeof(struct MData) + align - 1) / align * align;
+  struct vk_buffer matrixBuffer = vk_buffer_new(
+      matrixStride * RENDER.frameCount, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+          VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
   // Persistent mapping aka "While a range of device memory is host mapped, the
   // application is responsible for synchronizing both device and host access to
-  // that memory range."
-  //
-  // vkUnmapMemory(VK.dev, matrixBuffer.mem);
-
-  // Write out buffers into the shader descriptors
-  VkDescriptorBufferInfo bufferInfo = {0};
-  bufferInfo.buffer = matrixBuffer.buf;
-  bufferInfo.offset = 0;
-  bufferInfo.range = matrixBuffer.ci.size;
-
-  VkWriteDescriptorSet descriptorWrite = {0};
-  descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-  descriptorWrite.dstSet = descSet;
-  descriptorWrite.dstBinding = 0; // Remember the binding from the shader?
-  descriptorWrite.dstArrayElement = 0;
-  descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-  descriptorWrite.descriptorCount = 1;
-  descriptorWrite.pBufferInfo = &bufferInfo;
-  descriptorWrite.pImageInfo = NULL;       // Optional
-  descriptorWrite.pTexelBufferView = NULL; // Optional
-
-  vkUpdateDescriptorSets(VK.dev, 1, &descriptorWrite, 0, NULL);
+  // that memory range." Each frame only writes its slice after its fence. The
+  // allocator keeps the whole block mapped.
+
+  for (uint32_t i = 0; i < RENDER.frameCount; i++) {
+    struct frame *f = &RENDER.frame[i];
+    f->matrix = (char *)matrixBuffer.alloc.mapped + matrixStride * i;
+    memcpy(f->matrix, &matrixIn, sizeof(struct MData));
+
+    // Write out buffers into the shader descriptors
+    VkDescriptorBufferInfo bufferInfo = {0};
+    bufferInfo.buffer = matrixBuffer.buf;
+    bufferInfo.offset = matrixStride * i;
+    bufferInfo.range = sizeof(struct MData);
+
+    VkWriteDescriptorSet descriptorWrite = {0};
+    descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrite.dstSet = f->descSet;
+    descriptorWrite.dstBinding = 0; // Remember the binding from the shader?
+    descriptorWrite.dstArrayElement = 0;
+    descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    descriptorWrite.descriptorCount = 1;
+    descriptorWrite.pBufferInfo = &bufferInfo;
+    descriptorWrite.pImageInfo = NULL;       // Optional
+    descriptorWrite.pTexelBufferView = NULL; // Optional
+
+    vkUpdateDescriptorSets(VK.dev, 1, &descriptorWrite, 0, NULL);
+  }
 
   // Frame buffers for rendering
-  for (uint32_t i = 0; i < WSI.vk.imgCount; i++) {
-    VkImageView attachments[1] = {WSI.vk.swapImgView[i]};
-    VkFramebufferCreateInfo framebufferInfo = {0};
-    framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-    framebufferInfo.renderPass = renderPass;
-    framebufferInfo.attachmentCount = ARRAY_SIZEOF(attachments);
-    framebufferInfo.pAttachments = attachments;
-    framebufferInfo.width = swapSize().width;
-    framebufferInfo.height = swapSize().height;
-    framebufferInfo.layers = 1;
-
-    result = vkCreateFramebuffer(VK.dev, &framebufferInfo, NULL, &WSI.vk.fb[i]);
-    assert(result == VK_SUCCESS);
-  }
+  framebuffers_create(renderPass);
+  if (!headless)
+    scene_create(sceneRenderPass, 0);
 
   // Prepare command pools
   VkCommandPoolCreateInfo poolInfo = {0};
@@ -755,10 +4413,10 @@ int main(int argc, char *argv[]) {
   bufAllocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
   bufAllocInfo.commandPool = VK.cmdPool;
   bufAllocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-  bufAllocInfo.commandBufferCount = 1;
+  bufAllocInfo.commandBufferCount = RENDER.frameCount;
 
-  VkCommandBuffer commandBuffer;
-  vkAllocateCommandBuffers(VK.dev, &bufAllocInfo, &commandBuffer);
+  VkCommandBuffer commandBuffers[MAX_FRAMES_IN_FLIGHT];
+  vkAllocateCommandBuffers(VK.dev, &bufAllocInfo, commandBuffers);
 
   // Prepare sync objs
   VkSemaphoreCreateInfo semaphoreInfo = {0};
@@ -768,59 +4426,193 @@ int main(int argc, char *argv[]) {
   fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
   fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
 
-  VkSemaphore imageAvailableSemaphore;
-  VkSemaphore renderFinishedSemaphore;
-  VkFence inFlightFence;
-  assert(vkCreateSemaphore(VK.dev, &semaphoreInfo, NULL,
-                           &imageAvailableSemaphore) == VK_SUCCESS);
-  assert(vkCreateSemaphore(VK.dev, &semaphoreInfo, NULL,
-                           &renderFinishedSemaphore) == VK_SUCCESS);
-  assert(vkCreateFence(VK.dev, &fenceInfo, NULL, &inFlightFence) == VK_SUCCESS);
+  for (uint32_t i = 0; i < RENDER.frameCount; i++) {
+    struct frame *f = &RENDER.frame[i];
+    f->cmd = commandBuffers[i];
+    assert(vkCreateSemaphore(VK.dev, &semaphoreInfo, NULL,
+                             &f->imageAvailable) == VK_SUCCESS);
+    assert(vkCreateFence(VK.dev, &fenceInfo, NULL, &f->inFlight) ==
+           VK_SUCCESS);
+  }
+
+  // A pair of timestamps per frame tells the scheduler what the GPU costs.
+  VkQueryPool queryPool = VK_NULL_HANDLE;
+  uint32_t tsBits = queueFamilies[VK.gfxIdx].timestampValidBits;
+  uint64_t tsMask = tsBits >= 64 ? UINT64_MAX : (1ull << tsBits) - 1;
+#ifdef TRACE
+  TRACER.tsMask = tsMask;
+#endif
+  if (tsBits) {
+    VkQueryPoolCreateInfo queryPoolInfo = {0};
+    queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    queryPoolInfo.queryCount = 2 * RENDER.frameCount;
+    result = vkCreateQueryPool(VK.dev, &queryPoolInfo, NULL, &queryPool);
+    assert(result == VK_SUCCESS);
+  }
+  for (uint32_t i = 0; i < RENDER.frameCount; i++)
+    RENDER.frame[i].query = 2 * i;
 
   // Begin drawing
-  WSI.frame_done = true;
+  RENDER.frame_done = true;
+  PACE.enabled =
+      WSI.presentation && !OPTS.no_pace && !RENDER.uncapped && !WSI.fifo;
+  RENDER.lastCallback = now_ns();
+  PACE.due = true;
   float frame = 0;
-  while (!WSI.window_closed && wl_display_dispatch_pending(WSI.display) != -1) {
-    if (!WSI.frame_done)
-      continue;
+  uint64_t frameIdx = 0;
+  if (headless) {
+    BENCH.interval = calloc(OPTS.headless_frames, sizeof(uint64_t));
+    BENCH.cpu = calloc(OPTS.headless_frames, sizeof(uint64_t));
+    BENCH.gpu = calloc(OPTS.headless_frames, sizeof(uint64_t));
+    BENCH.start = now_ns();
+  }
+  while (!RENDER.quit) {
+    if (headless) {
+      // Nothing to wait for but the GPU.
+      if (BENCH.frames == OPTS.headless_frames)
+        break;
+    } else {
+      // Sleep until the wayland thread or the pacing timer has something for
+      // us unless a frame is already due.
+      render_poll(render_due() ? 0 : -1);
+      if (RENDER.quit)
+        break;
+      if (!render_due())
+        continue;
+    }
+
+    if (VK.vkWaitForPresentKHR)
+      present_throttle();
+    uint64_t frameStart = now_ns();
+    uint64_t stages[STAGE_COUNT] = {RENDER.dispatchNs};
+    uint64_t lap = frameStart;
+    TRACE_CALIBRATE();
 
     frame += 1;
-    vkWaitForFences(VK.dev, 1, &inFlightFence, VK_TRUE, UINT64_MAX);
+    atomic_fetch_add(&RENDER.drawn, 1);
+
+    // Only wait for the GPU to finish the frame that last used this slot, the
+    // newer ones keep running while we record.
+    struct frame *f = &RENDER.frame[frameIdx % RENDER.frameCount];
+    vkWaitForFences(VK.dev, 1, &f->inFlight, VK_TRUE, UINT64_MAX);
+    if (f->timed) {
+      uint64_t ts[2];
+      float period = deviceProperties.limits.timestampPeriod;
+      if (vkGetQueryPoolResults(VK.dev, queryPool, f->query, 2, sizeof(ts), ts,
+                                sizeof(ts[0]),
+                                VK_QUERY_RESULT_64_BIT) == VK_SUCCESS) {
+        uint64_t gpu = ((ts[1] - ts[0]) & tsMask) * (double)period;
+        cost_push(&PACE.gpu, gpu);
+        TRACE_GPU(f->id, ts, now_ns());
+        if (headless)
+          BENCH.gpu[BENCH.gpuFrames++] = gpu;
+        else
+          dynres_sample(gpu, f->scale);
+      }
+      f->timed = false;
+    }
+    stages[STAGE_FENCE] = stage_lap(&lap);
+    // The frame which last used this slot is done and so is every one before
+    // it, as are their slots' previous frames.
+    retire_collect(frameIdx >= RENDER.frameCount
+                       ? frameIdx - RENDER.frameCount + 1
+                       : 0);
     uint32_t imageIndex;
-    result = vkAcquireNextImageKHR(VK.dev, WSI.vk.swapchain, UINT64_MAX,
-                                   imageAvailableSemaphore, VK_NULL_HANDLE,
-                                   &imageIndex);
-    WSI.vk.recreate |= result == VK_ERROR_OUT_OF_DATE_KHR;
-
-    // If the swapchain had to be recreated, also recreate pipelines's
-    // framebuffers.
-    if (WSI.vk.recreate) {
-      WSI.vk.recreate = false;
-      recreate_swapchain();
-      // Frame buffers for rendering
-      for (uint32_t i = 0; i < WSI.vk.imgCount; i++) {
-        VkImageView attachments[1] = {WSI.vk.swapImgView[i]};
-        VkFramebufferCreateInfo framebufferInfo = {0};
-        framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-        framebufferInfo.renderPass = renderPass;
-        framebufferInfo.attachmentCount = ARRAY_SIZEOF(attachments);
-        framebufferInfo.pAttachments = attachments;
-        framebufferInfo.width = swapSize().width;
-        framebufferInfo.height = swapSize().height;
-        framebufferInfo.layers = 1;
-
-        result =
-            vkCreateFramebuffer(VK.dev, &framebufferInfo, NULL, &WSI.vk.fb[i]);
-        assert(result == VK_SUCCESS);
+    // Whether imageAvailable is to be waited on.
+    bool acquired = false;
+    if (headless) {
+      // Each frame slot owns an offscreen image.
+      imageIndex = f - RENDER.frame;
+    } else {
+      // Swap the swapchain out from under the frames in flight, what they use
+      // is retired rather than waited for.
+      resize_update();
+      if (WSI.vk.recreate) {
+        WSI.vk.recreate = false;
+        if (WSI.vk.dmabuf)
+          dmabuf_create(frameIdx);
+        else
+          recreate_swapchain(frameIdx);
+        // Render pass and pipeline are only compatible with the format they
+        // were made for, and the pipeline encodes for it or not.
+        if (WSI.vk.swapFormat != renderFormat ||
+            format_encodes() != encodeSrgb) {
+          retire((struct retired){RETIRED_PIPELINE,
+                                  .pipeline = graphicsPipeline},
+                 frameIdx);
+          retire((struct retired){RETIRED_RENDER_PASS,
+                                  .renderPass = renderPass},
+                 frameIdx);
+          retire((struct retired){RETIRED_RENDER_PASS,
+                                  .renderPass = sceneRenderPass},
+                 frameIdx);
+          retire((struct retired){RETIRED_RENDER_PASS,
+                                  .renderPass = damageRenderPass},
+                 frameIdx);
+          renderPass = render_pass_new(
+              WSI.vk.swapFormat, VK_IMAGE_LAYOUT_UNDEFINED, presentLayout);
+          sceneRenderPass = render_pass_new(
+              WSI.vk.swapFormat, VK_IMAGE_LAYOUT_UNDEFINED,
+              VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+          damageRenderPass = render_pass_new(WSI.vk.swapFormat,
+                                             presentLayout, presentLayout);
+          pipelineInfo.renderPass = renderPass;
+          encodeSrgb = format_encodes();
+          result = vkCreateGraphicsPipelines(VK.dev, VK_NULL_HANDLE, 1,
+                                             &pipelineInfo, NULL,
+                                             &graphicsPipeline);
+          assert(result == VK_SUCCESS);
+          renderFormat = WSI.vk.swapFormat;
+        }
+        framebuffers_create(renderPass);
+        scene_create(sceneRenderPass, frameIdx);
+        RENDER.swapFirstId = RENDER.presentId + 1;
+        // The new images hold nothing yet.
+        DAMAGE.valid = false;
+      }
+      // render_due() made sure one of our buffers is free. The compositor
+      // may still be reading what it released, wait for that on the GPU.
+      if (WSI.vk.dmabuf) {
+        imageIndex = dmabuf_acquire();
+        acquired =
+            dmabuf_fence_in(&WSI.vk.img[imageIndex], f->imageAvailable);
+      } else {
+        result = vkAcquireNextImageKHR(VK.dev, WSI.vk.swapchain, UINT64_MAX,
+                                       f->imageAvailable, VK_NULL_HANDLE,
+                                       &imageIndex);
+        // Nothing was acquired or signalled, go again with a new swapchain.
+        if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+          WSI.vk.recreate = true;
+          continue;
+        }
+        // Still presentable, replace it after this frame.
+        WSI.vk.recreate |= result == VK_SUBOPTIMAL_KHR;
+        acquired = true;
+        // Back from the WSI, so its last present and every one before it are
+        // done waiting.
+        RENDER.presentsDone = MAX(RENDER.presentsDone,
+                                  WSI.vk.img[imageIndex].presented);
       }
-      // WSI might signal this, so dump this semaphore.
-      vkDestroySemaphore(VK.dev, imageAvailableSemaphore, NULL);
-      assert(vkCreateSemaphore(VK.dev, &semaphoreInfo, NULL,
-                               &imageAvailableSemaphore) == VK_SUCCESS);
-      continue;
     }
+    stages[STAGE_ACQUIRE] = stage_lap(&lap);
+
     // Assuming all is good we can reset it.
-    vkResetFences(VK.dev, 1, &inFlightFence);
+    vkResetFences(VK.dev, 1, &f->inFlight);
+    uint64_t id = frameIdx++;
+    f->id = id;
+    if (!headless) {
+      latency_consume(id);
+      dynres_update();
+    }
+    RENDER.frame_done = false;
+    PACE.due = false;
+    // Queued frames go to consecutive vblanks.
+    if (WSI.fifo)
+      PACE.target = pace_next_vblank(frameStart + pace_budget());
+    PACE.lastTarget = PACE.target;
+    PACE.targets[id % PACE_TARGETS] =
+        PACE.enabled || WSI.fifo ? PACE.target : 0;
 
     // Begin recording rendering commands.
     // Depends on which framebuffer to use through RenderPassBegin
@@ -828,82 +4620,155 @@ int main(int argc, char *argv[]) {
     VkCommandBufferBeginInfo beginInfo = {0};
     beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
     // Can implicitly reset the cmdbuffer later.
-    vkBeginCommandBuffer(commandBuffer, &beginInfo);
+    vkBeginCommandBuffer(f->cmd, &beginInfo);
+    if (queryPool) {
+      vkCmdResetQueryPool(f->cmd, queryPool, f->query, 2);
+      vkCmdWriteTimestamp(f->cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool,
+                          f->query);
+    }
+
+    struct MData spin = spin_matrix(frame);
+    memcpy(f->matrix, &spin, sizeof(spin));
+
+    // Below full size the scene goes to the frame's own target and is
+    // upscaled into the swapchain image at the end.
+    bool scaled = DYNRES.enabled && DYNRES.scale < 1.0f;
+    VkExtent2D size = scaled ? dynres_size() : swapSize();
+    f->scale = scaled ? DYNRES.scale : 1.0f;
+    bool pressed = atomic_load(&RENDER.pressed);
+
+    // Redraw only around where the triangle was in this image and is now.
+    // Scaled frames are blitted whole and leave nothing to build on.
+    struct swap_image *img = &WSI.vk.img[imageIndex];
+    VkRect2D area = {{0, 0}, size};
+    VkRect2D changed = area;
+    bool partial = false;
+    if (!headless && !scaled && !OPTS.no_damage) {
+      float x0 = 1, y0 = 1, x1 = -1, y1 = -1;
+      for (uint32_t i = 0; i < ARRAY_SIZEOF(vertexIn); i++) {
+        // The shader's mat4 is column major.
+        float x = spin.m[0] * vertexIn[i].pos.p1 +
+                  spin.m[4] * vertexIn[i].pos.p2;
+        float y = spin.m[1] * vertexIn[i].pos.p1 +
+                  spin.m[5] * vertexIn[i].pos.p2;
+        x0 = MIN(x0, x);
+        y0 = MIN(y0, y);
+        x1 = MAX(x1, x);
+        y1 = MAX(y1, y);
+      }
+      VkRect2D box = damage_box(x0, y0, x1, y1, size);
+      partial = damage_frame(img, pressed, box, &area, &changed);
+      // A full redraw goes out as such.
+      if (!partial)
+        changed = area;
+      DAMAGE.drawn += (uint64_t)area.extent.width * area.extent.height;
+      DAMAGE.total += (uint64_t)size.width * size.height;
+    } else if (!headless) {
+      img->drawn = DAMAGE.valid = false;
+      // The upscale rewrites the whole swapchain image, not the scaled size.
+      changed = (VkRect2D){{0, 0}, swapSize()};
+    }
 
     VkRenderPassBeginInfo renderPassBeginInfo = {0};
     renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-    renderPassBeginInfo.renderPass = renderPass;
-    renderPassBeginInfo.framebuffer = WSI.vk.fb[imageIndex];
-    renderPassBeginInfo.renderArea.offset = (VkOffset2D){0, 0};
-    renderPassBeginInfo.renderArea.extent = swapSize();
-    VkClearValue clearColor = {{{0.2f, 0.4f, 0.9f, 1.0f}}};
+    renderPassBeginInfo.renderPass =
+        scaled ? sceneRenderPass : (partial ? damageRenderPass : renderPass);
+    renderPassBeginInfo.framebuffer = scaled ? f->sceneFb : img->fb;
+    renderPassBeginInfo.renderArea = area;
+    VkClearValue clearColor = {0};
+    memcpy(clearColor.color.float32, clearColors[pressed],
+           sizeof(clearColors[0]));
+    if (encodeSrgb) {
+      for (uint32_t i = 0; i < 3; i++)
+        clearColor.color.float32[i] = srgb_encode(clearColor.color.float32[i]);
+    }
     renderPassBeginInfo.clearValueCount = 1;
     renderPassBeginInfo.pClearValues = &clearColor;
 
-    vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo,
+    // Take back what the compositor was given last time.
+    if (WSI.vk.dmabuf && img->foreign)
+      dmabuf_barrier(f->cmd, img->img, true);
+    vkCmdBeginRenderPass(f->cmd, &renderPassBeginInfo,
                          VK_SUBPASS_CONTENTS_INLINE);
 
     // Add dynamic state
     VkViewport viewport = {0};
     viewport.x = 0.0f;
     viewport.y = 0.0f;
-    viewport.width = (float)swapSize().width;
-    viewport.height = (float)swapSize().height;
+    viewport.width = (float)size.width;
+    viewport.height = (float)size.height;
     viewport.minDepth = 0.0f;
     viewport.maxDepth = 1.0f;
-    vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
-
-    VkRect2D scissor = {0};
-    scissor.offset = (VkOffset2D){0, 0};
-    scissor.extent = swapSize();
-    vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
-
-    float theta = frame * 3.1415f / 200.f;
-    struct MData spin = {
-        // clang-format off
-        cosf(theta), -sinf(theta), 0.f, 0.f,
-        sinf(theta), cosf(theta), 0.f, 0.f,
-        0.f, 0.f, 1.f, 0.f,
-        0.f, 0.f, 0.f, 1.f,
-        // clang-format on
-    };
-    memcpy(data, &spin, (size_t)matrixBuffer.ci.size);
+    vkCmdSetViewport(f->cmd, 0, 1, &viewport);
+
+    // The viewport stays the whole image so the triangle lands in the same
+    // place, the scissor keeps it inside the render area.
+    vkCmdSetScissor(f->cmd, 0, 1, &area);
 
     // Set the pipeline to draw through
-    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+    vkCmdBindPipeline(f->cmd, VK_PIPELINE_BIND_POINT_GRAPHICS,
                       graphicsPipeline);
 
     // Bind draw data
     VkDeviceSize offsets[] = {0};
-    vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vertexBuffer.buf, offsets);
-    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
-                            pipelineLayout, 0, 1, &descSet, 0, NULL);
-
-    vkCmdDraw(commandBuffer, 3, 1, 0, 0);
-
-    vkCmdEndRenderPass(commandBuffer);
+    vkCmdBindVertexBuffers(f->cmd, 0, 1, &vertexBuffer.buf, offsets);
+    vkCmdBindDescriptorSets(f->cmd, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                            pipelineLayout, 0, 1, &f->descSet, 0, NULL);
+
+    vkCmdDraw(f->cmd, 3, 1, 0, 0);
+
+    vkCmdEndRenderPass(f->cmd);
+    if (scaled)
+      dynres_blit(f->cmd, f->scene, img->img, size);
+    if (WSI.vk.dmabuf) {
+      dmabuf_barrier(f->cmd, img->img, false);
+      img->foreign = true;
+    }
+    if (queryPool) {
+      vkCmdWriteTimestamp(f->cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                          queryPool, f->query + 1);
+      f->timed = true;
+    }
 
-    assert(vkEndCommandBuffer(commandBuffer) == VK_SUCCESS);
+    assert(vkEndCommandBuffer(f->cmd) == VK_SUCCESS);
+    stages[STAGE_RECORD] = stage_lap(&lap);
 
     VkSubmitInfo submitInfo = {0};
     submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
     // Waiting
-    VkSemaphore waitSemaphores[] = {imageAvailableSemaphore};
+    VkSemaphore waitSemaphores[] = {f->imageAvailable};
+    // The image is first written by the blit when scaled.
     VkPipelineStageFlags waitStages[] = {
-        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
-    submitInfo.waitSemaphoreCount = 1;
+        scaled ? VK_PIPELINE_STAGE_TRANSFER_BIT
+               : VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
+    submitInfo.waitSemaphoreCount = acquired ? 1 : 0;
     submitInfo.pWaitSemaphores = waitSemaphores;
     submitInfo.pWaitDstStageMask = waitStages;
     // Doing
     submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &commandBuffer;
+    submitInfo.pCommandBuffers = &f->cmd;
     // Signaling
-    VkSemaphore signalSemaphores[] = {renderFinishedSemaphore};
-    submitInfo.signalSemaphoreCount = 1;
+    VkSemaphore signalSemaphores[] = {img->renderFinished};
+    // Only exported to the dmabuf, without sync_files we wait on the fence.
+    submitInfo.signalSemaphoreCount =
+        headless || (WSI.vk.dmabuf && !DMABUF.syncFile) ? 0 : 1;
     submitInfo.pSignalSemaphores = signalSemaphores;
 
     // Begin drawing
-    assert(vkQueueSubmit(VK.gfx, 1, &submitInfo, inFlightFence) == VK_SUCCESS);
+    assert(vkQueueSubmit(VK.gfx, 1, &submitInfo, f->inFlight) == VK_SUCCESS);
+    stages[STAGE_SUBMIT] = stage_lap(&lap);
+    RENDER.dispatchNs = 0;
+
+    if (headless) {
+      stage_push(frameStart, stages);
+      TRACE_FRAME(id, frameStart, stages);
+      uint64_t now = now_ns();
+      if (BENCH.frames)
+        BENCH.interval[BENCH.frames - 1] = now - BENCH.lastSubmit;
+      BENCH.cpu[BENCH.frames++] = now - frameStart;
+      BENCH.lastSubmit = now;
+      continue;
+    }
 
     // Present.
     VkPresentInfoKHR presentInfo = {0};
@@ -914,13 +4779,364 @@ int main(int argc, char *argv[]) {
     presentInfo.swapchainCount = 1;
     presentInfo.pSwapchains = swapChains;
     presentInfo.pImageIndices = &imageIndex;
+    VkPresentIdKHR presentIdInfo = {0};
+    if (VK.vkWaitForPresentKHR) {
+      RENDER.presentId++;
+      presentIdInfo.sType = VK_STRUCTURE_TYPE_PRESENT_ID_KHR;
+      presentIdInfo.swapchainCount = 1;
+      presentIdInfo.pPresentIds = &RENDER.presentId;
+      presentInfo.pNext = &presentIdInfo;
+    }
+    // The WSI turns these into wl_surface.damage_buffer, without them it
+    // damages everything.
+    VkRectLayerKHR changedRect = {changed.offset, changed.extent, 0};
+    VkPresentRegionKHR region = {1, &changedRect};
+    VkPresentRegionsKHR regions = {0};
+    if (DAMAGE.incremental) {
+      regions.sType = VK_STRUCTURE_TYPE_PRESENT_REGIONS_KHR;
+      regions.pNext = presentInfo.pNext;
+      regions.swapchainCount = 1;
+      regions.pRegions = &region;
+      presentInfo.pNext = &regions;
+    }
 
-    result = vkQueuePresentKHR(VK.gfx, &presentInfo);
-    WSI.vk.recreate |=
-        (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR);
+    commit_prepare(id);
+
+    if (WSI.vk.dmabuf) {
+      dmabuf_commit(f, img, changed);
+      RENDER.timestampPending = false;
+    } else {
+      WSI.vk.img[imageIndex].presented = ++RENDER.presents;
+      result = vkQueuePresentKHR(VK.gfx, &presentInfo);
+      WSI.vk.recreate |=
+          (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR);
+      // A failed present never commits, a second timestamp would be an error.
+      if (result >= 0)
+        RENDER.timestampPending = false;
+    }
+    stages[STAGE_PRESENT] = stage_lap(&lap);
+    stage_push(frameStart, stages);
+    TRACE_FRAME(id, frameStart, stages);
+    cost_push(&PACE.cpu, lap - frameStart);
   }
 
+  vkDeviceWaitIdle(VK.dev);
+  if (headless)
+    bench_report(deviceProperties.deviceName);
+  if (headless && OPTS.stage_stats)
+    stage_report();
+  if (WSI.presentation)
+    pace_stats();
+  if (VK.vkWaitForPresentKHR)
+    present_wait_stats();
+  if (WSI.presentation && atomic_load(&RENDER.inputSeq))
+    latency_report();
+  if (OPTS.dynamic_res && !headless)
+    dynres_stats();
+  if (!OPTS.no_damage && !headless)
+    damage_stats();
+  if (WSI.vk.dmabuf)
+    dmabuf_stats();
+  vk_memory_stats(deviceProperties.limits.maxMemoryAllocationCount);
+
   // Cleanup left to reader.
 
+  return NULL;
+}
+
+int main(int argc, char *argv[]) {
+  static const struct option longOpts[] = {
+      {"loop-stats", no_argument, NULL, 's'},
+      {"frames-in-flight", required_argument, NULL, 'f'},
+      {"no-pace", no_argument, NULL, 'P'},
+      {"pace-margin", required_argument, NULL, 'm'},
+      {"present-mode", required_argument, NULL, 'p'},
+      {"max-queued", required_argument, NULL, 'q'},
+      {"tearing", no_argument, NULL, 't'},
+      {"scheduled", no_argument, NULL, 'S'},
+      {"headless", required_argument, NULL, 'H'},
+      {"stage-stats", no_argument, NULL, 'T'},
+      {"stage-json", required_argument, NULL, 'j'},
+      {"input-rate", required_argument, NULL, 'i'},
+      {"surface-format", required_argument, NULL, 'F'},
+      {"render-scale", required_argument, NULL, 'R'},
+      {"dynamic-res", no_argument, NULL, 'D'},
+      {"no-damage", no_argument, NULL, 'd'},
+      {"dmabuf", required_argument, NULL, 'B'},
+      {"cpu", no_argument, NULL, 'C'},
+#ifdef TRACE
+      {"trace", required_argument, NULL, 'r'},
+#endif
+      {"help", no_argument, NULL, 'h'},
+      {0},
+  };
+  int opt;
+  while ((opt = getopt_long(argc, argv, "sf:Pm:p:q:tSH:Tj:i:F:R:DdB:Ch",
+                            longOpts, NULL)) != -1) {
+    switch (opt) {
+    case 's':
+      OPTS.loop_stats = true;
+      break;
+    case 'f':
+      OPTS.frames_in_flight = CLAMP(atoi(optarg), 1, MAX_FRAMES_IN_FLIGHT);
+      break;
+    case 'P':
+      OPTS.no_pace = true;
+      break;
+    case 'm':
+      OPTS.pace_margin = (uint64_t)(atof(optarg) * 1e6);
+      break;
+    case 'p': {
+      uint32_t i = 0;
+      while (i < ARRAY_SIZEOF(presentModeNames) &&
+             strcmp(optarg, presentModeNames[i].name) != 0)
+        i++;
+      if (i == ARRAY_SIZEOF(presentModeNames)) {
+        usage(argv[0]);
+        return 1;
+      }
+      OPTS.present_mode = presentModeNames[i].mode;
+      break;
+    }
+    case 'q':
+      OPTS.max_queued = CLAMP(atoi(optarg), 0, 8);
+      break;
+    case 't':
+      OPTS.tearing = true;
+      break;
+    case 'S':
+      OPTS.scheduled = true;
+      break;
+    case 'H':
+      OPTS.backend = BACKEND_HEADLESS;
+      OPTS.headless_frames = CLAMP(atoi(optarg), 1, 10000000);
+      break;
+    case 'T':
+      OPTS.stage_stats = true;
+      break;
+    case 'j':
+      OPTS.stage_json = optarg;
+      break;
+    case 'i':
+      OPTS.input_rate = CLAMP(atoi(optarg), 0, 10000);
+      break;
+    case 'F': {
+      uint32_t i = 0;
+      while (i < ARRAY_SIZEOF(surfaceDepthNames) &&
+             strcmp(optarg, surfaceDepthNames[i]) != 0)
+        i++;
+      if (i == ARRAY_SIZEOF(surfaceDepthNames)) {
+        usage(argv[0]);
+        return 1;
+      }
+      OPTS.surface_depth = i;
+      break;
+    }
+    case 'R':
+      OPTS.render_scale = CLAMP(atof(optarg), 0.25, 2.0);
+      break;
+    case 'D':
+      OPTS.dynamic_res = true;
+      break;
+    case 'd':
+      OPTS.no_damage = true;
+      break;
+    case 'B':
+      OPTS.backend = BACKEND_DMABUF;
+      OPTS.dmabuf_buffers = CLAMP(atoi(optarg), 2, DMABUF_MAX_BUFFERS);
+      break;
+    case 'C':
+      OPTS.cpu = true;
+      break;
+#ifdef TRACE
+    case 'r':
+      TRACER.path = optarg;
+      break;
+#endif
+    case 'h':
+      usage(argv[0]);
+      return 0;
+    default:
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  // No compositor, so no wayland thread either. Render at the default window
+  // size right here.
+  if (OPTS.backend == BACKEND_HEADLESS) {
+    OPTS.max_queued = 0;
+    WSI.vk.w = MAX((int32_t)(300 * OPTS.render_scale + 0.5), 1);
+    WSI.vk.h = WSI.vk.w;
+    render_thread(NULL);
+    TRACE_WRITE();
+    return 0;
+  }
+
+  // Events for the render thread queue up from the first dispatch.
+  RENDER.queue.efd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  assert(RENDER.queue.efd != -1);
+  RENDER.epfd = epoll_create1(EPOLL_CLOEXEC);
+  assert(RENDER.epfd != -1);
+  epoll_watch(RENDER.epfd, RENDER.queue.efd, EPOLLIN);
+  PACE.timerfd = timer_new();
+  epoll_watch(RENDER.epfd, PACE.timerfd, EPOLLIN);
+  RENDER.fallbackfd = timer_new();
+  epoll_watch(RENDER.epfd, RENDER.fallbackfd, EPOLLIN);
+
+  WSI.display = wl_display_connect(NULL);
+  assert(WSI.display);
+  struct wl_registry *registry = wl_display_get_registry(WSI.display);
+  wl_registry_add_listener(registry, &registry_listener, NULL);
+  wl_display_roundtrip(WSI.display);
+
+  // Create our surface and add xdg_shell roles so it will be displayed.
+  WSI.w = 300;
+  WSI.h = 300;
+  // Leave the background to the compositor, it can fill it without reading
+  // a buffer or blending and we only draw the middle. Tearing is only done
+  // for a toplevel's own surface, so keep vulkan on it then.
+  WSI.window = WSI.surface;
+  if (WSI.subcompositor && WSI.singlePixel && WSI.viewporter &&
+      !OPTS.tearing) {
+    WSI.window = wl_compositor_create_surface(WSI.compositor);
+    WSI.subsurface = wl_subcompositor_get_subsurface(
+        WSI.subcompositor, WSI.surface, WSI.window);
+    // Our presents show up without committing the background each time.
+    wl_subsurface_set_desync(WSI.subsurface);
+    WSI.windowViewport =
+        wp_viewporter_get_viewport(WSI.viewporter, WSI.window);
+    for (uint32_t i = 0; i < ARRAY_SIZEOF(WSI.background); i++) {
+      const float *c = clearColors[i];
+      WSI.background[i] =
+          wp_single_pixel_buffer_manager_v1_create_u32_rgba_buffer(
+              WSI.singlePixel, srgb_u32(c[0]), srgb_u32(c[1]),
+              srgb_u32(c[2]), UINT32_MAX);
+    }
+    opaque_region_set(WSI.window);
+  }
+  WSI.xdg_surface = xdg_wm_base_get_xdg_surface(WSI.wm, WSI.window);
+  xdg_surface_add_listener(WSI.xdg_surface, &xdg_surface_listener, NULL);
+  WSI.xdg_toplevel = xdg_surface_get_toplevel(WSI.xdg_surface);
+  xdg_toplevel_add_listener(WSI.xdg_toplevel, &xdg_toplevel_listener, NULL);
+  xdg_toplevel_set_title(WSI.xdg_toplevel, "Wayland VK window");
+
+  // Let the compositor flip as soon as a frame lands. Drivers attach their own
+  // tearing control to the surface for IMMEDIATE, two is a protocol error, so
+  // pair our hint with MAILBOX which commits just as eagerly on wayland.
+  if (OPTS.tearing && WSI.tearingManager) {
+    WSI.tearing = wp_tearing_control_manager_v1_get_tearing_control(
+        WSI.tearingManager, WSI.surface);
+    wp_tearing_control_v1_set_presentation_hint(
+        WSI.tearing, WP_TEARING_CONTROL_V1_PRESENTATION_HINT_ASYNC);
+    OPTS.present_mode = VK_PRESENT_MODE_MAILBOX_KHR;
+  } else if (OPTS.tearing) {
+    fprintf(stderr, "no wp_tearing_control_manager_v1, tearing is up to "
+                    "the driver\n");
+    OPTS.present_mode = VK_PRESENT_MODE_IMMEDIATE_KHR;
+  }
+
+  // Queue presents on the compositor so the render thread never blocks in the
+  // driver. Drivers use these protocols themselves for FIFO, two of either
+  // object on a surface is a protocol error, so the driver gets MAILBOX.
+  if (OPTS.scheduled && WSI.fifoManager) {
+    WSI.fifo = wp_fifo_manager_v1_get_fifo(WSI.fifoManager, WSI.surface);
+    // Timestamps are on the presentation clock.
+    if (WSI.commitTiming && WSI.presentation)
+      WSI.commitTimer =
+          wp_commit_timing_manager_v1_get_timer(WSI.commitTiming, WSI.surface);
+    OPTS.present_mode = VK_PRESENT_MODE_MAILBOX_KHR;
+  } else if (OPTS.scheduled) {
+    fprintf(stderr, "no wp_fifo_manager_v1, ignoring --scheduled\n");
+  }
+
+  if (WSI.viewporter)
+    WSI.viewport = wp_viewporter_get_viewport(WSI.viewporter, WSI.surface);
+  // Which GPU the compositor uses and what it can scan out for the surface
+  // vulkan draws to. The first batch arrives before the render thread starts.
+  if (OPTS.backend == BACKEND_DMABUF && OPTS.cpu) {
+    fprintf(stderr, "--cpu draws to shared memory, ignoring --dmabuf\n");
+    OPTS.backend = BACKEND_WAYLAND;
+  }
+  if (OPTS.backend == BACKEND_DMABUF && !WSI.dmabuf) {
+    fprintf(stderr, "no zwp_linux_dmabuf_v1 v4, using the swapchain\n");
+    OPTS.backend = BACKEND_WAYLAND;
+  }
+  if (WSI.dmabuf) {
+    WSI.feedback =
+        zwp_linux_dmabuf_v1_get_surface_feedback(WSI.dmabuf, WSI.surface);
+    zwp_linux_dmabuf_feedback_v1_add_listener(
+        WSI.feedback, &dmabuf_feedback_listener, NULL);
+  }
+  // Fractional scales can only be drawn at through the viewport. The buffer
+  // scale stays 1, the viewport does all the mapping.
+  WSI.scale = 120;
+  if (WSI.viewport && WSI.fractionalManager) {
+    WSI.fractional = wp_fractional_scale_manager_v1_get_fractional_scale(
+        WSI.fractionalManager, WSI.surface);
+    wp_fractional_scale_v1_add_listener(WSI.fractional, &fractional_listener,
+                                        NULL);
+  }
+
+  // Get our top level configured for our swapchain. HiDPI goes through the
+  // viewport, a buffer scale would only do whole numbers.
+  wl_surface_set_buffer_scale(WSI.surface, 1);
+  wl_surface_commit(WSI.window);
+  wl_display_dispatch(WSI.display);
+  wl_display_roundtrip(WSI.display);
+
+  // Hand the render thread its starting size, anything after this arrives
+  // through the queue.
+  int32_t contentX, contentY;
+  content_rect(&contentX, &contentY, &WSI.vk.winW, &WSI.vk.winH);
+  WSI.vk.w = WSI.vk.winW;
+  WSI.vk.h = WSI.vk.winH;
+  WSI.vk.scale = WSI.scale;
+  WSI.vk.mainDevice = FEEDBACK.mainDevice;
+  WSI.vk.scanout = FEEDBACK.sent;
+  // Signals are read from a signalfd on this thread, the render thread must
+  // inherit the blocked mask.
+  sigset_t sigs;
+  sigemptyset(&sigs);
+  sigaddset(&sigs, SIGUSR1);
+  sigaddset(&sigs, SIGINT);
+  sigaddset(&sigs, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &sigs, NULL);
+  int ret = pthread_create(&RENDER.thread, NULL, render_thread, NULL);
+  assert(ret == 0);
+
+  // Sleep on the compositor's socket and our timers between frames.
+  WSI.epfd = epoll_create1(EPOLL_CLOEXEC);
+  assert(WSI.epfd != -1);
+  epoll_watch(WSI.epfd, wl_display_get_fd(WSI.display), EPOLLIN);
+  WSI.statsfd = timer_new();
+  epoll_watch(WSI.epfd, WSI.statsfd, EPOLLIN);
+  if (OPTS.loop_stats)
+    timer_arm(WSI.statsfd, now_ns() + 1000000000ull, 1000000000ull);
+  WSI.sigfd = signalfd(-1, &sigs, SFD_CLOEXEC | SFD_NONBLOCK);
+  assert(WSI.sigfd != -1);
+  epoll_watch(WSI.epfd, WSI.sigfd, EPOLLIN);
+  // Input is matched to presentation feedback, without it there is no latency
+  // to measure.
+  if (!WSI.presentation && (OPTS.input_rate || WSI.seat))
+    fprintf(stderr, "no wp_presentation, input latency is not measured\n");
+  WSI.inputfd = timer_new();
+  epoll_watch(WSI.epfd, WSI.inputfd, EPOLLIN);
+  if (OPTS.input_rate)
+    timer_arm(WSI.inputfd, now_ns() + 1000000000ull / OPTS.input_rate,
+              1000000000ull / OPTS.input_rate);
+
+  // This thread only dispatches wayland events from here on.
+  while (!WSI.window_closed) {
+    if (wsi_dispatch(-1) == -1)
+      break;
+  }
+
+  render_send((struct render_event){.type = EV_CLOSE});
+  pthread_join(RENDER.thread, NULL);
+  if (OPTS.stage_stats)
+    stage_report();
+  TRACE_WRITE();
+
   return 0;
 }
@@ -4,6 +4,13 @@ layout(location = 0) in vec3 fragColor;
 
 layout(location = 0) out vec4 outColor;
 
+// Set for formats that store what we write as is but are shown as sRGB.
+layout(constant_id = 0) const bool encodeSrgb = false;
+
 void main() {
-    outColor = vec4(fragColor, 1.0);
+    vec3 c = fragColor;
+    if (encodeSrgb)
+        c = mix(c * 12.92, 1.055 * pow(c, vec3(1.0 / 2.4)) - 0.055,
+                greaterThan(c, vec3(0.0031308)));
+    outColor = vec4(c, 1.0);
 }